@@ -0,0 +1,214 @@
+#include "m_pd.h"
+#include "analysis.h"
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define KEY_STICKINESS 0.1f  // Correlation bonus for staying in the key of the previous event
+
+// Krumhansl-Kessler probe tone profiles, tonic first
+static const float major_profile[12] = {
+    6.35f, 2.23f, 3.48f, 2.33f, 4.38f, 4.09f, 2.52f, 5.19f, 2.39f, 3.66f, 2.29f, 2.88f
+};
+static const float minor_profile[12] = {
+    6.33f, 2.68f, 3.52f, 5.38f, 2.60f, 3.53f, 2.54f, 4.75f, 3.98f, 2.69f, 3.34f, 3.17f
+};
+
+// Numerals by semitones above the tonic, relative to the major scale
+static const char *numerals[12] = {
+    "I", "bII", "II", "bIII", "III", "IV", "#IV", "V", "bVI", "VI", "bVII", "VII"
+};
+
+#define MAJOR_SCALE 0xAB5          // C D E F G A B
+#define MINOR_SCALE 0x5AD          // C D Eb F G Ab Bb
+#define HARMONIC_MINOR 0x9AD       // ... with the leading tone B
+
+// Profiles of all 24 keys, centred and scaled to unit length, so the dot product
+// with a pitch class profile is proportional to their correlation
+static float key_profiles[24][12];
+static int key_profiles_ready;
+
+static void init_key_profiles(void) {
+    for (int key = 0; key < 24; key++) {
+        const float *profile = key < 12 ? major_profile : minor_profile;
+        float mean = 0, norm = 0;
+        for (int i = 0; i < 12; i++) mean += profile[i];
+        mean /= 12;
+        for (int i = 0; i < 12; i++) norm += (profile[i] - mean) * (profile[i] - mean);
+        norm = sqrtf(norm);
+        for (int pc = 0; pc < 12; pc++) {
+            key_profiles[key][pc] = (profile[(pc - key % 12 + 12) % 12] - mean) / norm;
+        }
+    }
+    key_profiles_ready = 1;
+}
+
+// Chord tones as a pitch class mask relative to the root
+static int chord_mask(const t_chord_data *chord) {
+    int mask = 0;
+    for (int i = 0; i < chord->num_intervals; i++) {
+        if (chord->intervals[i] >= 0) mask |= 1 << (chord->intervals[i] % 12);
+    }
+    return mask;
+}
+
+static int rotate_mask(int mask, int semitones) {
+    semitones = (semitones % 12 + 12) % 12;
+    return ((mask << semitones) | (mask >> (12 - semitones))) & 0xFFF;
+}
+
+// Case of the diatonic triad on a degree of the key: 1 = major, 0 = minor or diminished
+static int degree_is_major(int degree, int scale) {
+    return (scale >> ((degree + 4) % 12)) & 1;
+}
+
+static void roman(char *buf, int size, int degree, int major) {
+    snprintf(buf, size, "%s", numerals[degree]);
+    if (!major) {
+        for (char *p = buf; *p; p++) {
+            if (*p == 'I' || *p == 'V') *p += 'a' - 'A';
+        }
+    }
+}
+
+// Quality written after the numeral: 7 for any minor or dominant seventh, maj7, o, ø7, + and 6
+static const char *numeral_suffix(int tones) {
+    int minor_third = (tones >> 3) & 1 && !((tones >> 4) & 1);
+    int flat_five = (tones >> 6) & 1 && !((tones >> 7) & 1);
+    int sharp_five = (tones >> 8) & 1 && !((tones >> 7) & 1) && !minor_third;
+    int seventh = (tones >> 10) & 1;
+    int major_seventh = (tones >> 11) & 1;
+
+    if (minor_third && flat_five) {
+        if (seventh) return "\xc3\xb8" "7";
+        return (tones >> 9) & 1 ? "o7" : "o";
+    }
+    if (major_seventh) return "maj7";
+    if (seventh) return sharp_five ? "+7" : "7";
+    if (sharp_five) return "+";
+    if ((tones >> 9) & 1) return "6";
+    return "";
+}
+
+static t_symbol *label_event(const t_chord_event *ev, const t_chord_event *next, int key) {
+    const t_chord_data *chord = &ev->parsed;
+    if (chord->num_intervals <= 0) return gensym("-");
+
+    int tonic = key % 12;
+    int scale = key >= KEY_MINOR ? MINOR_SCALE : MAJOR_SCALE;
+    int diatonic_scale = key >= KEY_MINOR ? (HARMONIC_MINOR | MINOR_SCALE) : MAJOR_SCALE;
+    int degree = (chord->root_offset - tonic + 12) % 12;
+    int tones = chord_mask(chord);
+    int absolute = rotate_mask(tones, degree);
+    int major_third = (tones >> 4) & 1;
+    int minor_third = (tones >> 3) & 1 && !major_third;
+    int dominant = major_third && !((tones >> 11) & 1);
+    const char *suffix = numeral_suffix(tones);
+    char numeral[16], target[16], buf[48];
+
+    // Dominants outside the key point at the degree a fifth below or, as tritone
+    // substitutes, a half step below when the next chord goes there
+    if (dominant && (absolute & diatonic_scale) != absolute) {
+        int to = (degree + 5) % 12;
+        if (to != 0 && ((scale >> to) & 1)) {
+            roman(target, sizeof(target), to, degree_is_major(to, scale));
+            snprintf(buf, sizeof(buf), "V%s/%s", suffix, target);
+            return gensym(buf);
+        }
+        if (next && (next->parsed.root_offset - chord->root_offset + 12) % 12 == 11) {
+            to = (degree + 11) % 12;
+            if (to == 0) {
+                snprintf(buf, sizeof(buf), "subV%s", suffix);
+            } else {
+                roman(target, sizeof(target), to, degree_is_major(to, scale));
+                snprintf(buf, sizeof(buf), "subV%s/%s", suffix, target);
+            }
+            return gensym(buf);
+        }
+    }
+
+    roman(numeral, sizeof(numeral), degree, !minor_third);
+    snprintf(buf, sizeof(buf), "%s%s", numeral, suffix);
+    return gensym(buf);
+}
+
+void analyze_harmony(t_chord_event *events, int num_events, int first, int last) {
+    if (!events || num_events <= 0) return;
+    if (!key_profiles_ready) init_key_profiles();
+    if (first < 0) first = 0;
+    if (last > num_events) last = num_events;
+    if (first > last) first = last;
+
+    // The changed events lie between first_beat and end_beat, every event whose window
+    // reaches into them is labelled again, starting from the first one
+    const t_chord_event *final = &events[num_events - 1];
+    int end_beat = last < num_events ? events[last].start : final->start + final->duration;
+    int first_beat = first < num_events ? events[first].start : end_beat;
+    int from = first;
+    while (from > 0 && events[from - 1].start >= first_beat - ANALYSIS_WINDOW) from--;
+    int base = from;
+    while (base > 0 && events[base - 1].start >= first_beat - 2 * ANALYSIS_WINDOW) base--;
+
+    // Prefix sums of the pitch class weights from base on: chord tones times duration,
+    // roots count double. Rows are filled as the window reaches them.
+    int rows = num_events - base + 1;
+    float *sums = (float *)getbytes(rows * 12 * sizeof(float));
+    if (!sums) return;
+    int filled = 0;
+
+    // Slide a window of events starting within ANALYSIS_WINDOW beats on either side
+    int lo = base, hi = base;
+    int previous = from > 0 ? events[from - 1].key : -1;
+    int i;
+    for (i = from; i < num_events; i++) {
+        while (events[lo].start < events[i].start - ANALYSIS_WINDOW) lo++;
+        while (hi < num_events && events[hi].start <= events[i].start + ANALYSIS_WINDOW) hi++;
+        for (; filled < hi - base; filled++) {
+            const t_chord_data *chord = &events[base + filled].parsed;
+            int duration = events[base + filled].duration;
+            float *next_row = &sums[(filled + 1) * 12];
+            memcpy(next_row, &sums[filled * 12], 12 * sizeof(float));
+            int mask = rotate_mask(chord_mask(chord), chord->root_offset);
+            for (int pc = 0; pc < 12; pc++) {
+                if (mask & (1 << pc)) next_row[pc] += duration;
+            }
+            if (chord->num_intervals > 0) next_row[chord->root_offset % 12] += duration;
+        }
+
+        float profile[12], mean = 0, norm = 0;
+        for (int pc = 0; pc < 12; pc++) {
+            profile[pc] = sums[(hi - base) * 12 + pc] - sums[(lo - base) * 12 + pc];
+            mean += profile[pc];
+        }
+        mean /= 12;
+        for (int pc = 0; pc < 12; pc++) norm += (profile[pc] - mean) * (profile[pc] - mean);
+        norm = norm > 0 ? sqrtf(norm) : 1;
+
+        int best = previous >= 0 ? previous : 0;
+        float best_score = -2;
+        for (int key = 0; key < 24; key++) {
+            float score = 0;
+            for (int pc = 0; pc < 12; pc++) score += profile[pc] * key_profiles[key][pc];
+            score /= norm;
+            if (key == previous) score += KEY_STICKINESS;
+            if (score > best_score) {
+                best_score = score;
+                best = key;
+            }
+        }
+
+        // Past the reach of the changed events the window is as before, so once a key
+        // comes out as before all the following ones do too
+        if (i >= last && events[i].start - ANALYSIS_WINDOW >= end_beat && best == events[i].key) break;
+        events[i].key = best;
+        previous = best;
+    }
+    freebytes(sums, rows * 12 * sizeof(float));
+
+    // A function also depends on the next chord
+    int label_end = i > last ? i : last;
+    for (int j = from > 0 ? from - 1 : 0; j < label_end; j++) {
+        events[j].function = label_event(&events[j], j + 1 < num_events ? &events[j + 1] : NULL,
+                                         events[j].key);
+    }
+}
@@ -0,0 +1,835 @@
+#include "m_pd.h"
+#include "chart_import.h"
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define IMPORT_CHUNK 65536
+#define IREAL_MAGIC "1r34LbKcu7"
+#define MAX_FIELDS 16
+#define MAX_HARMONIES 32
+
+// Growable character buffer
+typedef struct _chart_text {
+    char *data;
+    int size;
+    int capacity;
+} t_chart_text;
+
+static int text_add(t_chart_text *t, const char *s, int len) {
+    if (t->size + len + 1 > t->capacity) {
+        int capacity = t->capacity > 0 ? t->capacity : 256;
+        while (capacity < t->size + len + 1) capacity *= 2;
+        char *data = t->data ? (char *)resizebytes(t->data, t->capacity, capacity)
+                             : (char *)getbytes(capacity);
+        if (!data) return 0;
+        t->data = data;
+        t->capacity = capacity;
+    }
+    memcpy(t->data + t->size, s, len);
+    t->size += len;
+    t->data[t->size] = '\0';
+    return 1;
+}
+
+static int text_addc(t_chart_text *t, char c) {
+    return text_add(t, &c, 1);
+}
+
+// Append a chart token followed by a space
+static int text_token(t_chart_text *t, const char *token) {
+    return text_add(t, token, strlen(token)) && text_addc(t, ' ');
+}
+
+static void text_clear(t_chart_text *t) {
+    t->size = 0;
+    if (t->data) t->data[0] = '\0';
+}
+
+static void text_free(t_chart_text *t) {
+    if (t->data) freebytes(t->data, t->capacity);
+    t->data = NULL;
+    t->size = 0;
+    t->capacity = 0;
+}
+
+typedef struct _importer {
+    int song;            // Requested song
+    int num_songs;
+    t_chart_text chart;        // Converted chart
+    t_symbol *title;
+    int failed;          // Out of memory
+} t_importer;
+
+// ---------------------------------------------------------------------------
+// iReal Pro
+
+// Chart state while converting one iReal song
+typedef struct _ireal_bars {
+    t_chart_text current;      // Chords and dots of the bar being written
+    t_chart_text last;         // ... of the previous bar, for x
+    t_chart_text before_last;  // ... of the bar before, for r
+    char last_chord[64];
+} t_ireal_bars;
+
+// The music string is scrambled in blocks of 50 characters, the last 51 or fewer stay as they are
+static void ireal_unscramble(char *s, int len) {
+    char block[50];
+    while (len > 51) {
+        memcpy(block, s, 50);
+        for (int i = 0; i < 5; i++) {
+            s[i] = block[49 - i];
+            s[49 - i] = block[i];
+        }
+        for (int i = 10; i < 24; i++) {
+            s[i] = block[49 - i];
+            s[49 - i] = block[i];
+        }
+        s += 50;
+        len -= 50;
+    }
+}
+
+static void ireal_emit(t_importer *im, t_ireal_bars *bars, const char *token, int musical) {
+    if (!text_token(&im->chart, token)) im->failed = 1;
+    if (musical && !text_token(&bars->current, token)) im->failed = 1;
+}
+
+static void ireal_bar_line(t_importer *im, t_ireal_bars *bars, const char *token) {
+    if (bars->current.size > 0) {
+        t_chart_text swap = bars->before_last;
+        bars->before_last = bars->last;
+        bars->last = bars->current;
+        bars->current = swap;
+        text_clear(&bars->current);
+    }
+    ireal_emit(im, bars, token, 0);
+}
+
+// Copy the chords of an earlier bar into the current one
+static void ireal_repeat(t_importer *im, t_ireal_bars *bars, t_chart_text *from) {
+    if (from->size == 0) return;
+    if (!text_add(&im->chart, from->data, from->size) ||
+        !text_add(&bars->current, from->data, from->size)) {
+        im->failed = 1;
+    }
+}
+
+// Convert one chord: ^ = maj7, - = m, h = m7b5, o = dim, + = aug, alternate chords
+// in parentheses are dropped, the s and l small and large chord marks are stripped.
+// Returns the characters consumed.
+static int ireal_chord(t_importer *im, t_ireal_bars *bars, const char *s) {
+    char chord[64];
+    int len = 0;
+    int pos = 0;
+
+    chord[len++] = s[pos++];
+    if (s[pos] == 'b' || s[pos] == '#') chord[len++] = s[pos++];
+    while (s[pos] && strchr("0123456789^-+hob#susaltd", s[pos]) && len < 48) {
+        if (!strncmp(s + pos, "sus", 3) || !strncmp(s + pos, "alt", 3)) {
+            memcpy(chord + len, s + pos, 3);
+            len += 3;
+            pos += 3;
+            continue;
+        }
+        char c = s[pos++];
+        const char *add = NULL;
+        char single[2] = {c, 0};
+        switch (c) {
+            case '^': add = isdigit((unsigned char)s[pos]) ? "maj" : "maj7"; break;
+            case '-': add = "m"; break;
+            case 'h':
+                add = "m7b5";
+                if (s[pos] == '7') pos++;
+                break;
+            case 'o': add = "dim"; break;
+            case '+': add = "aug"; break;
+            case 's':
+            case 'l': add = ""; break;
+            default: add = single; break;
+        }
+        int n = strlen(add);
+        memcpy(chord + len, add, n);
+        len += n;
+    }
+    if (s[pos] == '/' && s[pos + 1] >= 'A' && s[pos + 1] <= 'G') {
+        chord[len++] = s[pos++];
+        chord[len++] = s[pos++];
+        if (s[pos] == 'b' || s[pos] == '#') chord[len++] = s[pos++];
+    }
+    chord[len] = '\0';
+
+    ireal_emit(im, bars, chord, 1);
+    strcpy(bars->last_chord, chord);
+    return pos;
+}
+
+// Directions written as text: <D.C. al Coda>, <D.S. al Fine>, <Fine>
+static void ireal_comment(t_importer *im, t_ireal_bars *bars, const char *s, int len) {
+    char lower[256];
+    if (len > 255) len = 255;
+    for (int i = 0; i < len; i++) lower[i] = tolower((unsigned char)s[i]);
+    lower[len] = '\0';
+
+    int jump = strstr(lower, "d.c.") || strstr(lower, "da capo");
+    int segno = strstr(lower, "d.s.") || strstr(lower, "dal segno");
+    if (jump || segno) {
+        ireal_emit(im, bars, jump ? "D.C." : "D.S.", 0);
+        if (strstr(lower, "al coda")) ireal_emit(im, bars, "al Coda", 0);
+        else if (strstr(lower, "al fine")) ireal_emit(im, bars, "al Fine", 0);
+    } else if (strstr(lower, "fine")) {
+        ireal_emit(im, bars, "Fine", 0);
+    }
+}
+
+static void ireal_convert(t_importer *im, const char *s) {
+    t_ireal_bars bars;
+    memset(&bars, 0, sizeof(bars));
+
+    // The first of two coda signs is where to leave, the second the coda itself
+    int codas = 0;
+    for (const char *p = s; *p; p++) {
+        if (*p == 'Q') codas++;
+    }
+    int coda_seen = 0;
+
+    while (*s && !im->failed) {
+        if (!strncmp(s, "XyQ", 3)) { s += 3; continue; }      // Empty cells
+        if (!strncmp(s, "LZ", 2)) {
+            ireal_bar_line(im, &bars, "|");
+            s += 2;
+            continue;
+        }
+        if (!strncmp(s, "Kcl", 3)) {                            // Repeat the previous bar
+            ireal_bar_line(im, &bars, "|");
+            ireal_repeat(im, &bars, &bars.last);
+            s += 3;
+            continue;
+        }
+
+        char buf[16];
+        switch (*s) {
+            case '{': ireal_bar_line(im, &bars, "|:"); break;
+            case '}': ireal_bar_line(im, &bars, ":|"); break;
+            case '|':
+            case '[':
+            case ']':
+            case 'Z': ireal_bar_line(im, &bars, "|"); break;
+            case '*':                                            // Section letter
+                if (s[1]) s++;
+                break;
+            case 'T':                                            // T44, T34, T68, T12 = 12/8
+                if (isdigit((unsigned char)s[1]) && isdigit((unsigned char)s[2])) {
+                    if (s[1] == '1' && s[2] == '2') snprintf(buf, sizeof(buf), "12/8");
+                    else snprintf(buf, sizeof(buf), "%c/%c", s[1], s[2]);
+                    ireal_emit(im, &bars, buf, 0);
+                    s += 2;
+                }
+                break;
+            case 'N':                                            // Endings N1, N2, N3
+                if (s[1] >= '1' && s[1] <= '9') {
+                    snprintf(buf, sizeof(buf), "%c.", s[1]);
+                    ireal_emit(im, &bars, buf, 0);
+                    s++;
+                }
+                break;
+            case 'S': ireal_emit(im, &bars, "Segno", 0); break;
+            case 'Q':
+                coda_seen++;
+                if (codas >= 2 && coda_seen == 1) {
+                    ireal_emit(im, &bars, "To", 0);
+                }
+                ireal_emit(im, &bars, "Coda", 0);
+                break;
+            case '<': {
+                const char *end = strchr(s, '>');
+                if (!end) end = s + strlen(s) - 1;
+                ireal_comment(im, &bars, s + 1, end - s - 1);
+                s = end;
+                break;
+            }
+            case '(': {                                          // Alternate chord
+                const char *end = strchr(s, ')');
+                if (!end) end = s + strlen(s) - 1;
+                s = end;
+                break;
+            }
+            case 'x': ireal_repeat(im, &bars, &bars.last); break;
+            case 'r':                                            // Repeat the previous two bars
+                if (bars.before_last.size > 0) {
+                    t_chart_text last = {NULL, 0, 0};
+                    if (!text_add(&last, bars.last.data, bars.last.size)) {
+                        im->failed = 1;
+                        break;
+                    }
+                    ireal_repeat(im, &bars, &bars.before_last);
+                    ireal_bar_line(im, &bars, "|");
+                    ireal_repeat(im, &bars, &last);
+                    text_free(&last);
+                }
+                break;
+            case 'n':                                            // No chord: hold the previous one
+            case 'p':                                            // Slash: one more beat
+                if (bars.current.size > 0 && *s == 'p') ireal_emit(im, &bars, ".", 1);
+                else if (bars.last_chord[0]) ireal_emit(im, &bars, bars.last_chord, 1);
+                break;
+            case 'W':                                            // Invisible root, skip the chord
+                s++;
+                while (*s && strchr("0123456789^-+hob#susaltd/ABCDEFG", *s)) s++;
+                continue;
+            default:
+                if (*s >= 'A' && *s <= 'G') {
+                    s += ireal_chord(im, &bars, s);
+                    continue;
+                }
+                break;                                           // Spacing and layout marks
+        }
+        s++;
+    }
+
+    text_free(&bars.current);
+    text_free(&bars.last);
+    text_free(&bars.before_last);
+}
+
+// One song: Title=Composer=...=Key=n=Music=..., the music field of irealb:// links
+// starts with the scrambling marker, irealbook:// links have it plain as the 6th field
+static void ireal_song(t_importer *im, t_chart_text *song, int plain) {
+    char *fields[MAX_FIELDS];
+    int num_fields = 0;
+    char *music = NULL;
+
+    if (song->size == 0) return;
+    char *p = song->data;
+    fields[num_fields++] = p;
+    while ((p = strchr(p, '=')) && num_fields < MAX_FIELDS) {
+        *p++ = '\0';
+        fields[num_fields++] = p;
+    }
+    for (int i = 1; i < num_fields && !music; i++) {
+        if (!strncmp(fields[i], IREAL_MAGIC, strlen(IREAL_MAGIC))) {
+            music = fields[i] + strlen(IREAL_MAGIC);
+            ireal_unscramble(music, strlen(music));
+        }
+    }
+    if (!music && plain && num_fields > 5) music = fields[5];
+    if (!music) return;  // Playlist name after the last song
+
+    im->num_songs++;
+    if (im->num_songs != im->song) return;
+    im->title = gensym(fields[0]);
+    ireal_convert(im, music);
+}
+
+static int from_hex(int c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Scan for irealb:// and irealbook:// links, percent-decode them and split them into
+// songs at === as they stream by. Only the text of one song is held at a time.
+static void import_ireal(FILE *fp, char *chunk, int len, t_importer *im) {
+    t_chart_text song = {NULL, 0, 0};
+    char recent[16];
+    int in_link = 0;
+    int plain = 0;
+    int percent = -1;      // Digits of a %XX escape read so far, -1 = none
+    int percent_value = 0;
+    memset(recent, ' ', sizeof(recent) - 1);
+    recent[sizeof(recent) - 1] = '\0';
+
+    do {
+        for (int i = 0; i < len && !im->failed; i++) {
+            int c = (unsigned char)chunk[i];
+
+            if (!in_link) {
+                memmove(recent, recent + 1, sizeof(recent) - 2);
+                recent[sizeof(recent) - 2] = c;
+                int n = sizeof(recent) - 1;
+                if (!strcmp(recent + n - 9, "irealb://")) {
+                    in_link = 1;
+                    plain = 0;
+                } else if (!strcmp(recent + n - 12, "irealbook://")) {
+                    in_link = 1;
+                    plain = 1;
+                }
+                text_clear(&song);
+                continue;
+            }
+
+            // A link ends at its quote in HTML or at the end of the line
+            if (c == '"' || c == '\'' || c == '<' || c == '>' || c == '\n' || c == '\r') {
+                ireal_song(im, &song, plain);
+                text_clear(&song);
+                in_link = 0;
+                memset(recent, ' ', sizeof(recent) - 1);
+                continue;
+            }
+            if (percent >= 0) {
+                int digit = from_hex(c);
+                if (digit < 0) {
+                    percent = -1;
+                    continue;
+                }
+                percent_value = percent_value * 16 + digit;
+                if (++percent < 2) continue;
+                c = percent_value;
+                percent = -1;
+            } else if (c == '%') {
+                percent = 0;
+                percent_value = 0;
+                continue;
+            }
+
+            if (!text_addc(&song, c)) {
+                im->failed = 1;
+                break;
+            }
+            if (song.size >= 3 && !strcmp(song.data + song.size - 3, "===")) {
+                song.size -= 3;
+                song.data[song.size] = '\0';
+                ireal_song(im, &song, plain);
+                text_clear(&song);
+            }
+        }
+    } while (!im->failed && (len = fread(chunk, 1, IMPORT_CHUNK, fp)) > 0);
+
+    if (in_link) ireal_song(im, &song, plain);
+    text_free(&song);
+}
+
+// ---------------------------------------------------------------------------
+// MusicXML
+
+typedef struct _harmony {
+    char chord[64];
+    int pos;             // Position in divisions from the start of the measure
+} t_harmony;
+
+typedef struct _xml_state {
+    char tag[512];       // Current tag without the brackets
+    int tag_len;
+    int in_tag;
+    int in_comment;
+    char text[128];      // Text since the last tag
+    int text_len;
+    int done;            // First part finished
+
+    // Harmony being read
+    char root_step;
+    int root_alter;
+    char kind[32];
+    char bass_step;
+    int bass_alter;
+    char degrees[32];
+    int degree_value;
+    int degree_alter;
+    char degree_type[16];
+    int harmony_offset;  // Divisions from the current position to the chord
+    int in_harmony;
+
+    // Notes and timing
+    int divisions;
+    int duration;
+    int note_chord;
+    int note_grace;
+    int pos;
+    int beats;
+    int beat_type;
+    int meter_written;   // beats/beat_type last written to the chart
+
+    // Measure being read
+    t_harmony harmonies[MAX_HARMONIES];
+    int num_harmonies;
+    int forward_repeat;
+    int backward_repeat;
+    int ending;
+    int segno;
+    int coda;
+    int to_coda;
+    int fine;
+    int jump;            // 1 = D.C., 2 = D.S.
+    int jumped;          // A D.C./D.S. was written, later coda signs are targets
+    int seen_to_coda;
+    int seen_fine;
+    char last_chord[64];
+} t_xml_state;
+
+static const struct {
+    const char *kind;
+    const char *suffix;
+} xml_kinds[] = {
+    {"major", ""}, {"minor", "m"}, {"augmented", "aug"}, {"diminished", "dim"},
+    {"dominant", "7"}, {"major-seventh", "maj7"}, {"minor-seventh", "m7"},
+    {"diminished-seventh", "dim7"}, {"augmented-seventh", "aug7"},
+    {"half-diminished", "m7b5"}, {"major-minor", "mmaj7"}, {"major-sixth", "6"},
+    {"minor-sixth", "m6"}, {"dominant-ninth", "9"}, {"major-ninth", "maj9"},
+    {"minor-ninth", "m9"}, {"dominant-11th", "11"}, {"major-11th", "maj11"},
+    {"minor-11th", "m11"}, {"dominant-13th", "13"}, {"major-13th", "maj13"},
+    {"minor-13th", "m13"}, {"suspended-second", "sus2"}, {"suspended-fourth", "sus4"},
+    {"power", "5"}, {NULL, NULL}
+};
+
+// Helper function to decode the predefined entities and character references in place,
+// characters are written as UTF-8
+static void xml_decode(char *s) {
+    static const struct {
+        const char *name;
+        char c;
+    } entities[] = {{"amp;", '&'}, {"lt;", '<'}, {"gt;", '>'}, {"quot;", '"'}, {"apos;", '\''}};
+    char *out = s;
+    while (*s) {
+        if (*s != '&') {
+            *out++ = *s++;
+            continue;
+        }
+        int done = 0;
+        if (s[1] == '#') {
+            char *end;
+            long code = s[2] == 'x' ? strtol(s + 3, &end, 16) : strtol(s + 2, &end, 10);
+            if (*end == ';' && end > s + 2 && code > 0 && code < 0x110000) {
+                if (code < 0x80) {
+                    *out++ = code;
+                } else if (code < 0x800) {
+                    *out++ = 0xC0 | (code >> 6);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else if (code < 0x10000) {
+                    *out++ = 0xE0 | (code >> 12);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                } else {
+                    *out++ = 0xF0 | (code >> 18);
+                    *out++ = 0x80 | ((code >> 12) & 0x3F);
+                    *out++ = 0x80 | ((code >> 6) & 0x3F);
+                    *out++ = 0x80 | (code & 0x3F);
+                }
+                s = end + 1;
+                done = 1;
+            }
+        } else {
+            for (int i = 0; i < (int)(sizeof(entities) / sizeof(entities[0])); i++) {
+                int n = strlen(entities[i].name);
+                if (!strncmp(s + 1, entities[i].name, n)) {
+                    *out++ = entities[i].c;
+                    s += n + 1;
+                    done = 1;
+                    break;
+                }
+            }
+        }
+        if (!done) *out++ = *s++;  // A lone & stays as it is
+    }
+    *out = '\0';
+}
+
+// Value of an attribute inside the current tag, or NULL
+static const char *xml_attribute(t_xml_state *st, const char *name, char *value, int size) {
+    int len = strlen(name);
+    const char *p = st->tag;
+    while ((p = strstr(p, name))) {
+        const char *q = p + len;
+        int starts = p > st->tag && isspace((unsigned char)p[-1]);
+        p++;
+        if (!starts) continue;
+        while (isspace((unsigned char)*q)) q++;
+        if (*q++ != '=') continue;
+        while (isspace((unsigned char)*q)) q++;
+        char quote = *q++;
+        if (quote != '"' && quote != '\'') return NULL;
+        int n = 0;
+        while (*q && *q != quote && n < size - 1) value[n++] = *q++;
+        value[n] = '\0';
+        xml_decode(value);
+        return value;
+    }
+    return NULL;
+}
+
+static void xml_add_harmony(t_xml_state *st) {
+    if (!st->root_step || !strcmp(st->kind, "none") || st->num_harmonies >= MAX_HARMONIES) return;
+
+    const char *suffix = "";
+    for (int i = 0; xml_kinds[i].kind; i++) {
+        if (!strcmp(st->kind, xml_kinds[i].kind)) suffix = xml_kinds[i].suffix;
+    }
+    t_harmony *h = &st->harmonies[st->num_harmonies++];
+    int n = snprintf(h->chord, sizeof(h->chord), "%c%s%s%s", st->root_step,
+                     st->root_alter < 0 ? "b" : st->root_alter > 0 ? "#" : "", suffix, st->degrees);
+    if (st->bass_step && n < (int)sizeof(h->chord) - 4) {
+        snprintf(h->chord + n, sizeof(h->chord) - n, "/%c%s", st->bass_step,
+                 st->bass_alter < 0 ? "b" : st->bass_alter > 0 ? "#" : "");
+    }
+    h->pos = st->pos + st->harmony_offset > 0 ? st->pos + st->harmony_offset : 0;
+}
+
+// Write a finished measure: start marks, chords with dots where they are uneven, end marks
+static void xml_measure(t_importer *im, t_xml_state *st) {
+    t_chart_text *out = &im->chart;
+    char buf[32];
+    int ok = 1;
+
+    if (st->num_harmonies == 0 && !st->last_chord[0]) return;  // Pickup before the first chord
+
+    int meter = st->beats * 100 + st->beat_type;
+    if (meter != st->meter_written) {
+        snprintf(buf, sizeof(buf), "%d/%d", st->beats, st->beat_type);
+        ok &= text_token(out, buf);
+        st->meter_written = meter;
+    }
+    if (st->forward_repeat) ok &= text_token(out, "|:");
+    if (st->ending) {
+        snprintf(buf, sizeof(buf), "%d.", st->ending);
+        ok &= text_token(out, buf);
+    }
+    if (st->segno) ok &= text_token(out, "Segno");
+    if (st->coda) ok &= text_token(out, "Coda");
+
+    // Beats from the harmony positions, plain chords when they carry no timing
+    int beat_div = st->divisions * 4 / (st->beat_type > 0 ? st->beat_type : 4);
+    if (beat_div <= 0) beat_div = 1;
+    int starts[MAX_HARMONIES + 1];
+    int count = 0;
+    const char *chords[MAX_HARMONIES + 1];
+    if (st->last_chord[0] && (st->num_harmonies == 0 || st->harmonies[0].pos >= beat_div)) {
+        chords[count] = st->last_chord;  // The previous chord continues into this measure
+        starts[count++] = 0;
+    }
+    for (int i = 0; i < st->num_harmonies; i++) {
+        chords[count] = st->harmonies[i].chord;
+        starts[count] = count == 0 ? 0 : (st->harmonies[i].pos + beat_div / 2) / beat_div;
+        count++;
+    }
+    int timed = count > 1;
+    for (int i = 1; i < count; i++) {
+        if (starts[i] <= starts[i - 1] || starts[i] >= st->beats) timed = 0;
+    }
+    for (int i = 0; i < count; i++) {
+        ok &= text_token(out, chords[i]);
+        int beats = (i + 1 < count ? starts[i + 1] : st->beats) - starts[i];
+        for (int d = 1; timed && d < beats; d++) ok &= text_token(out, ".");
+    }
+    if (st->num_harmonies > 0) {
+        strcpy(st->last_chord, st->harmonies[st->num_harmonies - 1].chord);
+    }
+
+    if (st->to_coda) ok &= text_token(out, "To") && text_token(out, "Coda");
+    if (st->fine) ok &= text_token(out, "Fine");
+    if (st->jump) {
+        ok &= text_token(out, st->jump == 1 ? "D.C." : "D.S.");
+        if (st->seen_to_coda) ok &= text_token(out, "al") && text_token(out, "Coda");
+        else if (st->seen_fine) ok &= text_token(out, "al") && text_token(out, "Fine");
+    }
+    ok &= text_token(out, st->backward_repeat ? ":|" : "|");
+    if (!ok) im->failed = 1;
+}
+
+static void xml_tag(t_importer *im, t_xml_state *st) {
+    char value[64];
+    char *tag = st->tag;
+    int closing = tag[0] == '/';
+    int empty = st->tag_len > 0 && tag[st->tag_len - 1] == '/';
+    char name[64];
+    int n = 0;
+    const char *p = tag + closing;
+    while (*p && !isspace((unsigned char)*p) && *p != '/' && n < (int)sizeof(name) - 1) name[n++] = *p++;
+    name[n] = '\0';
+    const char *text = st->text;
+
+    if (st->done) return;
+
+    if (!closing) {
+        if (!strcmp(name, "measure")) {
+            st->num_harmonies = 0;
+            st->pos = 0;
+            st->forward_repeat = st->backward_repeat = st->ending = 0;
+            st->segno = st->coda = st->to_coda = st->fine = st->jump = 0;
+        } else if (!strcmp(name, "harmony")) {
+            st->in_harmony = 1;
+            st->root_step = st->bass_step = 0;
+            st->root_alter = st->bass_alter = 0;
+            st->kind[0] = st->degrees[0] = '\0';
+            st->harmony_offset = 0;
+        } else if (!strcmp(name, "note")) {
+            st->note_chord = st->note_grace = 0;
+            st->duration = 0;
+        } else if (!strcmp(name, "backup") || !strcmp(name, "forward")) {
+            st->duration = 0;
+        } else if (!strcmp(name, "chord")) {
+            st->note_chord = 1;
+        } else if (!strcmp(name, "grace")) {
+            st->note_grace = 1;
+        } else if (!strcmp(name, "degree")) {
+            st->degree_value = st->degree_alter = 0;
+            st->degree_type[0] = '\0';
+        } else if (!strcmp(name, "repeat")) {
+            if (xml_attribute(st, "direction", value, sizeof(value))) {
+                if (!strcmp(value, "forward")) st->forward_repeat = 1;
+                if (!strcmp(value, "backward")) st->backward_repeat = 1;
+            }
+        } else if (!strcmp(name, "ending")) {
+            if (xml_attribute(st, "type", value, sizeof(value)) && !strcmp(value, "start") &&
+                xml_attribute(st, "number", value, sizeof(value))) {
+                st->ending = atoi(value);
+            }
+        } else if (!strcmp(name, "segno")) {
+            st->segno = 1;
+        } else if (!strcmp(name, "coda")) {
+            // A coda sign before the D.C./D.S. is where to leave, after it the target
+            if (st->jumped) st->coda = 1;
+            else st->to_coda = st->seen_to_coda = 1;
+        } else if (!strcmp(name, "sound")) {
+            if (xml_attribute(st, "dacapo", value, sizeof(value)) && !strcmp(value, "yes")) st->jump = 1;
+            if (xml_attribute(st, "dalsegno", value, sizeof(value))) st->jump = 2;
+            if (xml_attribute(st, "tocoda", value, sizeof(value))) st->to_coda = st->seen_to_coda = 1;
+            if (xml_attribute(st, "fine", value, sizeof(value))) st->fine = st->seen_fine = 1;
+            if (st->jump) st->jumped = 1;
+        }
+        if (!empty) return;
+    }
+
+    if (!strcmp(name, "root-step")) st->root_step = toupper((unsigned char)text[0]);
+    else if (!strcmp(name, "root-alter")) st->root_alter = atoi(text);
+    else if (!strcmp(name, "bass-step")) st->bass_step = toupper((unsigned char)text[0]);
+    else if (!strcmp(name, "bass-alter")) st->bass_alter = atoi(text);
+    else if (!strcmp(name, "kind")) {
+        strncpy(st->kind, text, sizeof(st->kind) - 1);
+        st->kind[sizeof(st->kind) - 1] = '\0';
+    }
+    else if (!strcmp(name, "degree-value")) st->degree_value = atoi(text);
+    else if (!strcmp(name, "degree-alter")) st->degree_alter = atoi(text);
+    else if (!strcmp(name, "degree-type")) {
+        strncpy(st->degree_type, text, sizeof(st->degree_type) - 1);
+        st->degree_type[sizeof(st->degree_type) - 1] = '\0';
+    }
+    else if (!strcmp(name, "degree")) {
+        int len = strlen(st->degrees);
+        if (strcmp(st->degree_type, "subtract") && st->degree_value > 0 && len < 24) {
+            snprintf(st->degrees + len, sizeof(st->degrees) - len, "%s%s%d",
+                     st->degree_alter < 0 ? "b" : st->degree_alter > 0 ? "#" : "",
+                     !st->degree_alter && !strcmp(st->degree_type, "add") ? "add" : "",
+                     st->degree_value);
+        }
+    }
+    else if (!strcmp(name, "harmony")) {
+        xml_add_harmony(st);
+        st->in_harmony = 0;
+    }
+    else if (!strcmp(name, "offset") && st->in_harmony) st->harmony_offset = atoi(text);
+    else if (!strcmp(name, "divisions")) st->divisions = atoi(text);
+    else if (!strcmp(name, "beats")) st->beats = atoi(text) > 0 ? atoi(text) : 4;
+    else if (!strcmp(name, "beat-type")) st->beat_type = atoi(text) > 0 ? atoi(text) : 4;
+    else if (!strcmp(name, "duration")) st->duration = atoi(text);
+    else if (!strcmp(name, "note")) {
+        if (!st->note_chord && !st->note_grace) st->pos += st->duration;
+    }
+    else if (!strcmp(name, "backup")) st->pos -= st->duration;
+    else if (!strcmp(name, "forward")) st->pos += st->duration;
+    else if (!strcmp(name, "work-title") || (!strcmp(name, "movement-title") && !im->title)) {
+        im->title = gensym(text);
+    }
+    else if (!strcmp(name, "measure")) xml_measure(im, st);
+    else if (!strcmp(name, "part")) st->done = 1;
+}
+
+// Stream the file through a tag scanner, measures are converted as they close
+static void import_musicxml(FILE *fp, char *chunk, int len, t_importer *im) {
+    t_xml_state *st = (t_xml_state *)getbytes(sizeof(t_xml_state));
+    if (!st) {
+        im->failed = 1;
+        return;
+    }
+    st->divisions = 1;
+    st->beats = 4;
+    st->beat_type = 4;
+
+    do {
+        for (int i = 0; i < len && !st->done && !im->failed; i++) {
+            char c = chunk[i];
+            if (st->in_comment) {
+                // Comments and declarations end at -->
+                st->tag[st->tag_len % 3] = c;
+                st->tag_len++;
+                if (c == '>' && st->tag_len >= 3 &&
+                    st->tag[(st->tag_len - 2) % 3] == '-' && st->tag[(st->tag_len - 3) % 3] == '-') {
+                    st->in_comment = 0;
+                }
+                continue;
+            }
+            if (!st->in_tag) {
+                if (c == '<') {
+                    st->in_tag = 1;
+                    st->tag_len = 0;
+                    while (st->text_len > 0 && isspace((unsigned char)st->text[st->text_len - 1])) {
+                        st->text_len--;
+                    }
+                    st->text[st->text_len] = '\0';
+                    xml_decode(st->text);
+                } else if (st->text_len < (int)sizeof(st->text) - 1 &&
+                           (st->text_len > 0 || !isspace((unsigned char)c))) {
+                    st->text[st->text_len++] = c;
+                }
+                continue;
+            }
+            if (c == '>') {
+                st->tag[st->tag_len] = '\0';
+                st->in_tag = 0;
+                if (st->tag[0] != '?' && st->tag[0] != '!') xml_tag(im, st);
+                st->text_len = 0;
+                continue;
+            }
+            if (st->tag_len < (int)sizeof(st->tag) - 1) st->tag[st->tag_len++] = c;
+            if (st->tag_len == 3 && !strncmp(st->tag, "!--", 3)) {
+                st->in_tag = 0;
+                st->in_comment = 1;
+                st->tag_len = 0;
+            }
+        }
+    } while (!st->done && !im->failed && (len = fread(chunk, 1, IMPORT_CHUNK, fp)) > 0);
+
+    // A score is one song
+    im->num_songs = 1;
+    freebytes(st, sizeof(t_xml_state));
+}
+
+// ---------------------------------------------------------------------------
+
+int import_chart(FILE *fp, const char *filename, int song, t_import_result *result) {
+    t_importer im;
+    memset(&im, 0, sizeof(im));
+    im.song = song > 0 ? song : 1;
+    memset(result, 0, sizeof(t_import_result));
+
+    char *chunk = (char *)getbytes(IMPORT_CHUNK + 1);
+    if (!chunk) return IMPORT_FAILED;
+    int len = fread(chunk, 1, IMPORT_CHUNK, fp);
+    chunk[len] = '\0';
+
+    // MusicXML by extension or by its root element
+    const char *ext = strrchr(filename, '.');
+    int xml = (ext && (!strcmp(ext, ".xml") || !strcmp(ext, ".musicxml"))) ||
+              strstr(chunk, "<score-partwise") || strstr(chunk, "<score-timewise");
+    if (xml) import_musicxml(fp, chunk, len, &im);
+    else import_ireal(fp, chunk, len, &im);
+    freebytes(chunk, IMPORT_CHUNK + 1);
+
+    result->num_songs = im.num_songs;
+    result->title = im.title ? im.title : &s_;
+    if (im.failed) {
+        text_free(&im.chart);
+        return IMPORT_FAILED;
+    }
+    if (im.num_songs < im.song) {
+        text_free(&im.chart);
+        return IMPORT_NO_SONG;
+    }
+    if (im.chart.size == 0) {
+        text_free(&im.chart);
+        return IMPORT_NO_CHORDS;
+    }
+    result->chart = im.chart.data;
+    result->chart_size = im.chart.capacity;
+    return IMPORT_OK;
+}
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 void debug_print_chord(const char* prefix, const t_chord_data* chord) {
     info_post("%s: Root: %d, Intervals:", prefix, chord->root_offset);
@@ -13,6 +15,204 @@ void debug_print_chord(const char* prefix, const t_chord_data* chord) {
     }
 }
 
+static const char spelling_letters[8] = "CDEFGAB";
+static const int spelling_letter_pcs[7] = {0, 2, 4, 5, 7, 9, 11};
+
+// Alteration needed to reach a pitch class from a letter (-6..5)
+static int letter_alteration(int pc, int letter) {
+    return (pc - spelling_letter_pcs[letter] + 18) % 12 - 6;
+}
+
+static void spell_with_letter(char *name, int pc, int letter) {
+    int alter = letter_alteration(pc, letter);
+    int len = 0;
+    name[len++] = spelling_letters[letter];
+    for (int a = alter; a < 0; a++) name[len++] = 'b';
+    for (int a = alter; a > 0; a--) name[len++] = '#';
+    name[len] = '\0';
+}
+
+// Fill the spelling table for a key like "Eb", "F#" or "Gm". Diatonic notes follow
+// the key signature, the others prefer flats in flat keys and sharps in sharp keys.
+// Without a key the common lead sheet names (Db Eb F# Ab Bb) are used.
+// Returns 0 if the key could not be read.
+int build_spelling(t_symbol *key, t_spelling names) {
+    static const char *default_names[12] = {
+        "C", "Db", "D", "Eb", "E", "F", "F#", "G", "Ab", "A", "Bb", "B"
+    };
+    static const int major_steps[7] = {0, 2, 4, 5, 7, 9, 11};
+    
+    for (int i = 0; i < 12; i++) {
+        strcpy(names[i], default_names[i]);
+    }
+    if (!key || !key->s_name[0]) return 1;
+    
+    const char *str = key->s_name;
+    const char *l = strchr("CDEFGAB", toupper((unsigned char)str[0]));
+    if (!l) return 0;
+    int letter = l - "CDEFGAB";
+    int root = spelling_letter_pcs[letter];
+    int pos = 1;
+    if (str[pos] == 'b') { root = (root + 11) % 12; pos++; }
+    else if (str[pos] == '#') { root = (root + 1) % 12; pos++; }
+    
+    // Minor keys share the signature of their relative major
+    if (str[pos] == 'm') {
+        letter = (letter + 2) % 7;
+        root = (root + 3) % 12;
+    }
+    
+    // Spell the scale degrees of the major key
+    int flats = 0, sharps = 0;
+    int degree_letter[12];
+    for (int pc = 0; pc < 12; pc++) {
+        degree_letter[pc] = -1;
+    }
+    for (int i = 0; i < 7; i++) {
+        int pc = (root + major_steps[i]) % 12;
+        degree_letter[pc] = (letter + i) % 7;
+        spell_with_letter(names[pc], pc, degree_letter[pc]);
+        if (letter_alteration(pc, degree_letter[pc]) < 0) flats = 1;
+        if (letter_alteration(pc, degree_letter[pc]) > 0) sharps = 1;
+    }
+    if (!flats && !sharps) return 1;  // C major / A minor keep the default names
+    
+    // Chromatic notes sit between two degrees: take a natural letter if one fits,
+    // otherwise lower the degree above in flat keys and raise the one below in sharp keys
+    for (int pc = 0; pc < 12; pc++) {
+        if (degree_letter[pc] >= 0) continue;
+        int above = degree_letter[(pc + 1) % 12];
+        int below = degree_letter[(pc + 11) % 12];
+        int use = flats ? above : below;
+        if (letter_alteration(pc, above) == 0) use = above;
+        else if (letter_alteration(pc, below) == 0) use = below;
+        else if (abs(letter_alteration(pc, use)) > 1) use = (use == above) ? below : above;
+        spell_with_letter(names[pc], pc, use);
+    }
+    return 1;
+}
+
+// Respell a chord symbol with its root moved by a number of semitones
+t_symbol *spell_chord_symbol(const t_chord_data *chord, int semitones, t_spelling names) {
+    const char *str = chord->original ? chord->original->s_name : "";
+    
+    // Skip leading whitespace and the written root
+    while (*str && (!isprint((unsigned char)*str) || isspace((unsigned char)*str))) {
+        str++;
+    }
+    if (!strchr("CDEFGAB", *str) || !*str) {
+        return chord->original;
+    }
+    str++;
+    if (*str == 'b' || *str == '#') str++;
+    
+    char buf[MAXPDSTRING];
+    int root = ((chord->root_offset + semitones) % 12 + 12) % 12;
+    
+    // A slash bass moves with the root, e.g. Cmaj7/E up a tone is Dmaj7/F#
+    const char *slash = strchr(str, '/');
+    const char *letter = slash ? strchr(spelling_letters, slash[1]) : NULL;
+    if (!slash || !slash[1] || !letter) {
+        snprintf(buf, sizeof(buf), "%s%s", names[root], str);
+        return gensym(buf);
+    }
+    const char *rest = slash + 2;
+    int bass = spelling_letter_pcs[letter - spelling_letters];
+    if (*rest == 'b' || *rest == '#') {
+        bass += *rest == 'b' ? -1 : 1;
+        rest++;
+    }
+    bass = ((bass + semitones) % 12 + 12) % 12;
+    snprintf(buf, sizeof(buf), "%s%.*s/%s%s", names[root], (int)(slash - str), str, names[bass], rest);
+    return gensym(buf);
+}
+
+static const char *chord_scale_names[NUM_CHORD_SCALES] = {
+    "none", "ionian", "lydian", "lydian-augmented", "mixolydian", "lydian-dominant",
+    "mixolydian-b13", "half-whole", "altered", "dorian", "phrygian", "aeolian",
+    "melodic-minor", "locrian", "locrian-#2", "whole-half"
+};
+
+// Scale steps in semitones above the root, one bit per step
+static const unsigned short chord_scale_steps[NUM_CHORD_SCALES] = {
+    0x000,  // none
+    0xAB5,  // ionian            0 2 4 5 7 9 11
+    0xAD5,  // lydian            0 2 4 6 7 9 11
+    0xB55,  // lydian augmented  0 2 4 6 8 9 11
+    0x6B5,  // mixolydian        0 2 4 5 7 9 10
+    0x6D5,  // lydian dominant   0 2 4 6 7 9 10
+    0x5B5,  // mixolydian b13    0 2 4 5 7 8 10
+    0x6DB,  // half-whole        0 1 3 4 6 7 9 10
+    0x55B,  // altered           0 1 3 4 6 8 10
+    0x6AD,  // dorian            0 2 3 5 7 9 10
+    0x5AB,  // phrygian          0 1 3 5 7 8 10
+    0x5AD,  // aeolian           0 2 3 5 7 8 10
+    0xAAD,  // melodic minor     0 2 3 5 7 9 11
+    0x56B,  // locrian           0 1 3 5 6 8 10
+    0x56D,  // locrian #2        0 2 3 5 6 8 10
+    0xB6D   // whole-half        0 2 3 5 6 8 9 11
+};
+
+const char *chord_scale_name(int scale) {
+    return (scale >= 0 && scale < NUM_CHORD_SCALES) ? chord_scale_names[scale] : chord_scale_names[0];
+}
+
+// Assign the usual chord scale to a chord and return it as a 12-bit mask of pitch
+// classes (bit 0 = C). The chord tones are always part of the mask.
+int chord_scale(const t_chord_data *chord, unsigned short *mask) {
+    *mask = 0;
+    if (chord->num_intervals <= 0) return SCALE_NONE;
+    
+    unsigned short tones = 0;
+    for (int i = 0; i < chord->num_intervals; i++) {
+        tones |= 1 << (chord->intervals[i] % 12);
+    }
+    int third = chord->num_intervals > 1 ? chord->intervals[1] : 4;
+    int fifth = chord->num_intervals > 2 ? chord->intervals[2] : 7;
+    int has_b7 = 0, has_maj7 = 0;
+    for (int i = 3; i < chord->num_intervals; i++) {
+        if (chord->intervals[i] == 10) has_b7 = 1;
+        if (chord->intervals[i] == 11) has_maj7 = 1;
+    }
+    int b9 = (tones >> 1) & 1;
+    int sharp9 = third == 4 && ((tones >> 3) & 1);
+    int sharp11 = (tones >> 6) & 1;
+    int b13 = fifth == 8 || ((tones >> 8) & 1);
+    
+    int scale;
+    if (third == 4) {
+        if (has_b7) {
+            if ((b9 || sharp9) && b13) scale = SCALE_ALTERED;
+            else if (b9 || sharp9) scale = SCALE_HALF_WHOLE;
+            else if (sharp11) scale = SCALE_LYDIAN_DOMINANT;
+            else if (b13) scale = SCALE_MIXOLYDIAN_B13;
+            else scale = SCALE_MIXOLYDIAN;
+        } else if (fifth == 8) {
+            scale = SCALE_LYDIAN_AUGMENTED;
+        } else if (sharp11) {
+            scale = SCALE_LYDIAN;
+        } else {
+            scale = SCALE_IONIAN;
+        }
+    } else if (fifth == 6) {
+        if (has_b7) scale = ((tones >> 2) & 1) ? SCALE_LOCRIAN_2 : SCALE_LOCRIAN;
+        else scale = SCALE_WHOLE_HALF;
+    } else if (has_maj7) {
+        scale = SCALE_MELODIC_MINOR;
+    } else if (b9) {
+        scale = SCALE_PHRYGIAN;
+    } else if (b13) {
+        scale = SCALE_AEOLIAN;
+    } else {
+        scale = SCALE_DORIAN;
+    }
+    
+    unsigned short relative = chord_scale_steps[scale] | tones;
+    int root = chord->root_offset % 12;
+    *mask = ((relative << root) | (relative >> (12 - root))) & 0xFFF;
+    return scale;
+}
+
 t_chord_data parse_chord_symbol(t_symbol *sym) {
     t_chord_data chord = {
         .original = sym,
@@ -121,6 +321,15 @@ t_chord_data parse_chord_symbol(t_symbol *sym) {
         } else if (strncmp(&str[pos], "MA", 2) == 0) {
             modifier = 1;
             pos += 2;
+        } else if (strncmp(&str[pos], "alt", 3) == 0) {
+            // Altered dominant: the fifth is raised (#5 = b13), b9 and #9 go on top of the seventh
+            static const int altered[2] = {13, 15};
+            chord.intervals[2] = 8;
+            for (int i = 0; i < 2 && chord.num_intervals < 12; i++) {
+                chord.intervals[chord.num_intervals++] = altered[i];
+            }
+            pos += 3;
+            continue;
         }
         
         while (isdigit(str[pos])) {
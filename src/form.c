@@ -0,0 +1,180 @@
+#include "m_pd.h"
+#include "form.h"
+#include <string.h>
+
+// Ending numbers per bar: an ending lasts until the bar that closes it with :|,
+// an ending without a closing :| covers just the bar it is written on.
+// last[] marks bars belonging to the highest ending of their group.
+static void resolve_endings(const t_bar *bars, int num_bars, int *ending, char *last) {
+    for (int i = 0; i < num_bars; i++) {
+        ending[i] = 0;
+        last[i] = 0;
+    }
+
+    for (int i = 0; i < num_bars; i++) {
+        if (!bars[i].volta) continue;
+
+        int end = i;
+        for (int j = i; j < num_bars; j++) {
+            if (j > i && (bars[j].volta || (bars[j].flags & BAR_REPEAT_START))) break;
+            if (bars[j].flags & BAR_REPEAT_END) {
+                end = j;
+                break;
+            }
+        }
+        for (int j = i; j <= end; j++) {
+            ending[j] = bars[i].volta;
+        }
+    }
+
+    // Consecutive ending bars form one group; its highest number is taken after D.C./D.S.
+    int group_start = 0;
+    while (group_start < num_bars) {
+        if (!ending[group_start]) {
+            group_start++;
+            continue;
+        }
+        int group_end = group_start;
+        int highest = 0;
+        while (group_end < num_bars && ending[group_end]) {
+            if (ending[group_end] > highest) highest = ending[group_end];
+            group_end++;
+        }
+        for (int j = group_start; j < group_end; j++) {
+            last[j] = (ending[j] == highest);
+        }
+        group_start = group_end;
+    }
+}
+
+static void add_segment(const t_bar *bars, t_form_segment *segments, int *count, int *beats,
+                        int start_bar, int end_bar) {
+    if (end_bar <= start_bar) return;
+
+    t_form_segment *seg = &segments[(*count)++];
+    seg->start_bar = start_bar;
+    seg->end_bar = end_bar;
+    seg->start_beat = *beats;
+    seg->start_bar_number = 0;
+    if (*count > 1) {
+        const t_form_segment *prev = seg - 1;
+        seg->start_bar_number = prev->start_bar_number + prev->end_bar - prev->start_bar;
+    }
+    *beats += bars[end_bar - 1].start + bars[end_bar - 1].length - bars[start_bar].start;
+}
+
+int compile_form(const t_bar *bars, int num_bars,
+                 t_form_segment **segments, int *num_segments) {
+    *segments = NULL;
+    *num_segments = 0;
+    if (!bars || num_bars <= 0) return 0;
+
+    int *ending = (int *)getbytes(num_bars * sizeof(int));
+    char *last = (char *)getbytes(num_bars);
+    char *taken = (char *)getbytes(num_bars);
+    // Every jump or skipped ending closes a segment, and each can happen at most once per bar
+    int max_segments = 3 * num_bars + 4;
+    t_form_segment *segs = (t_form_segment *)getbytes(max_segments * sizeof(t_form_segment));
+    if (!ending || !last || !taken || !segs) {
+        if (ending) freebytes(ending, num_bars * sizeof(int));
+        if (last) freebytes(last, num_bars);
+        if (taken) freebytes(taken, num_bars);
+        if (segs) freebytes(segs, max_segments * sizeof(t_form_segment));
+        return 0;
+    }
+    memset(taken, 0, num_bars);
+    resolve_endings(bars, num_bars, ending, last);
+
+    int segno = -1;
+    int coda = -1;
+    for (int i = 0; i < num_bars; i++) {
+        if ((bars[i].flags & BAR_SEGNO) && segno < 0) segno = i;
+        if ((bars[i].flags & BAR_CODA) && coda < 0) coda = i;
+    }
+
+    int count = 0;
+    int beats = 0;
+    int b = 0;
+    int seg_start = 0;
+    int pass = 1;            // Pass through the current repeat, selects the ending
+    int repeat_start = 0;
+    int returning = 0;       // Just jumped back to repeat_start
+    int jumped = 0;          // D.C./D.S. taken, repeats are no longer played
+    int al = 0;              // BAR_AL_* of the D.C./D.S. taken
+    int guard = 0;
+
+    while (b < num_bars && count < max_segments - 1 && guard++ < 8 * num_bars) {
+        const t_bar *bar = &bars[b];
+
+        if (ending[b]) {
+            int play = jumped ? last[b] : (ending[b] == pass);
+            if (!play) {
+                add_segment(bars, segs, &count, &beats, seg_start, b);
+                b++;
+                seg_start = b;
+                continue;
+            }
+        }
+
+        if ((bar->flags & BAR_REPEAT_START) && !returning) {
+            repeat_start = b;
+            pass = 1;
+        }
+        returning = 0;
+
+        if (jumped && (al & BAR_AL_FINE) && (bar->flags & BAR_FINE)) {
+            b++;
+            break;
+        }
+
+        if (jumped && (al & BAR_AL_CODA) && (bar->flags & BAR_TO_CODA) && coda >= 0) {
+            add_segment(bars, segs, &count, &beats, seg_start, b + 1);
+            al = 0;
+            b = coda;
+            seg_start = b;
+            continue;
+        }
+
+        if (bar->flags & BAR_REPEAT_END) {
+            if (!jumped && !taken[b]) {
+                taken[b] = 1;
+                add_segment(bars, segs, &count, &beats, seg_start, b + 1);
+                b = repeat_start;
+                seg_start = b;
+                pass++;
+                returning = 1;
+                continue;
+            }
+            repeat_start = b + 1;
+            pass = 1;
+        }
+
+        if ((bar->flags & (BAR_DA_CAPO | BAR_DAL_SEGNO)) && !jumped) {
+            add_segment(bars, segs, &count, &beats, seg_start, b + 1);
+            jumped = 1;
+            al = bar->flags & (BAR_AL_CODA | BAR_AL_FINE);
+            b = ((bar->flags & BAR_DAL_SEGNO) && segno >= 0) ? segno : 0;
+            seg_start = b;
+            repeat_start = b;
+            pass = 1;
+            continue;
+        }
+
+        b++;
+    }
+    add_segment(bars, segs, &count, &beats, seg_start, b < num_bars ? b : num_bars);
+
+    freebytes(ending, num_bars * sizeof(int));
+    freebytes(last, num_bars);
+    freebytes(taken, num_bars);
+
+    if (count == 0) {
+        freebytes(segs, max_segments * sizeof(t_form_segment));
+        return 0;
+    }
+
+    *segments = (t_form_segment *)resizebytes(segs, max_segments * sizeof(t_form_segment),
+                                              count * sizeof(t_form_segment));
+    *num_segments = count;
+    return beats;
+}
@@ -0,0 +1,20 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include "m_pd.h"
+#include "chord_data.h"
+
+#define ANALYSIS_WINDOW 16    // Beats on either side of an event that decide its key
+#define KEY_MINOR 12          // Added to the tonic of minor keys
+
+// Label every event with its local key (events[i].key) and its Roman numeral in that
+// key (events[i].function). Keys come from a sliding window over the chord tones,
+// correlated with the Krumhansl-Kessler profiles of all 24 keys, in linear time.
+// Numerals are relative to the major scale (bIII, bVI, bVII in minor) and name
+// secondary dominants (V7/ii) and tritone substitutes (subV7/IV).
+// Events first to last (exclusive) are new, the events before them and the ones after
+// them, which only moved, keep their labels unless the new events are in their window.
+// Pass 0 and num_events to label the whole chart.
+void analyze_harmony(t_chord_event *events, int num_events, int first, int last);
+
+#endif // ANALYSIS_H
@@ -0,0 +1,28 @@
+#ifndef CHART_IMPORT_H
+#define CHART_IMPORT_H
+
+#include "m_pd.h"
+#include <stdio.h>
+
+// Result codes of import_chart
+enum {
+    IMPORT_OK,
+    IMPORT_NO_SONG,      // The file holds fewer songs than requested
+    IMPORT_NO_CHORDS,    // The song has no chords
+    IMPORT_FAILED        // Out of memory
+};
+
+typedef struct _import_result {
+    char *chart;         // Chart in the space-and-bar format, free with freebytes(chart, chart_size)
+    int chart_size;
+    int num_songs;       // Songs in the file
+    t_symbol *title;     // Title of the imported song
+} t_import_result;
+
+// Import song number song (counted from 1) from an iReal Pro playlist (irealb:// or
+// irealbook:// links in text or HTML) or a MusicXML file. The file is read in chunks
+// and parsed as it streams, only the requested song is converted. MusicXML is
+// recognised by the file name or its first chunk.
+int import_chart(FILE *fp, const char *filename, int song, t_import_result *result);
+
+#endif // CHART_IMPORT_H
@@ -6,18 +6,63 @@
 typedef struct _chord_data {
     t_symbol *original;     // Original chord symbol
     int root_offset;        // Semitones from C (0-11)
-    int intervals[12];      // Array of intervals in semitones
+    signed char intervals[12]; // Array of intervals in semitones
     int num_intervals;      // Number of intervals used
 } t_chord_data;
 
+// Chord scales assigned by chord_scale()
+enum {
+    SCALE_NONE,
+    SCALE_IONIAN,
+    SCALE_LYDIAN,
+    SCALE_LYDIAN_AUGMENTED,
+    SCALE_MIXOLYDIAN,
+    SCALE_LYDIAN_DOMINANT,
+    SCALE_MIXOLYDIAN_B13,
+    SCALE_HALF_WHOLE,
+    SCALE_ALTERED,
+    SCALE_DORIAN,
+    SCALE_PHRYGIAN,
+    SCALE_AEOLIAN,
+    SCALE_MELODIC_MINOR,
+    SCALE_LOCRIAN,
+    SCALE_LOCRIAN_2,
+    SCALE_WHOLE_HALF,
+    NUM_CHORD_SCALES
+};
+
+#define MAX_VOICES 6
+
+typedef struct _voicing {
+    unsigned char notes[MAX_VOICES]; // MIDI notes, ascending
+    unsigned char count;             // Number of notes used
+} t_voicing;
+
 typedef struct _chord_event {
     t_symbol *chord;     // The chord symbol (like "C", "Dm7", etc.)
     int duration;        // Duration in beats
+    int start;           // Start beat within the written chart
+    int bar;             // Index of the written bar containing this event
     t_chord_data parsed; // Parsed chord data
+    t_symbol *spelled;   // Chord symbol respelled for the current transposition
+    int spelled_version; // Spelling version the respelled symbol was made for
+    t_voicing voicing;   // Precomputed voice-led voicing
+    unsigned char anticipated; // Written with a > prefix, its first beat comes early
+    unsigned short scale_mask; // Chord scale as pitch classes, bit 0 = C
+    unsigned char scale;       // Chord scale, one of SCALE_*
+    signed char key;     // Local key from analyze_harmony(): tonic pitch class, +12 for minor
+    t_symbol *function;  // Roman numeral of the chord in its local key
 } t_chord_event;
 
+// Pitch class names used when respelling transposed chords
+typedef char t_spelling[12][4];
+
 // Function declarations
 t_chord_data parse_chord_symbol(t_symbol *sym);
 void debug_print_chord(const char* prefix, const t_chord_data* chord);
+int build_spelling(t_symbol *key, t_spelling names);
+t_symbol *spell_chord_symbol(const t_chord_data *chord, int semitones, t_spelling names);
+int chord_scale(const t_chord_data *chord, unsigned short *mask);
+const char *chord_scale_name(int scale);
 
 #endif // CHORD_DATA_H 
\ No newline at end of file
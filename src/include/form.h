@@ -0,0 +1,51 @@
+#ifndef FORM_H
+#define FORM_H
+
+#include "m_pd.h"
+
+// Navigation flags attached to a written bar
+#define BAR_REPEAT_START  0x001  // |: before the bar
+#define BAR_REPEAT_END    0x002  // :| after the bar
+#define BAR_SEGNO         0x004  // Segno sign at the start of the bar
+#define BAR_CODA          0x008  // Coda sign at the start of the bar (jump target)
+#define BAR_TO_CODA       0x010  // "To Coda" at the end of the bar
+#define BAR_FINE          0x020  // Fine at the end of the bar
+#define BAR_DA_CAPO       0x040  // D.C. at the end of the bar
+#define BAR_DAL_SEGNO     0x080  // D.S. at the end of the bar
+#define BAR_AL_CODA       0x100  // D.C./D.S. continues al Coda
+#define BAR_AL_FINE       0x200  // D.C./D.S. continues al Fine
+
+typedef struct _bar {
+    int first_event;     // Index of the first event in this bar
+    int num_events;      // Number of events in this bar
+    int start;           // Start beat within the written chart
+    int length;          // Length in beats
+    int meter;           // Beats per bar
+    int meter_unit;      // Note value of a beat (0 = taken from the time message)
+    int flags;           // BAR_* navigation flags
+    int volta;           // Ending number written on this bar (0 = none)
+    int dotted;          // Durations written with dots, kept when the meter changes
+} t_bar;
+
+// A run of consecutive written bars played in one go
+typedef struct _form_segment {
+    int start_bar;       // First written bar
+    int end_bar;         // One past the last written bar
+    int start_beat;      // Start beat within the performed form
+    int start_bar_number; // Index of the first bar within the performed form
+} t_form_segment;
+
+// Position within the performed form
+typedef struct _play_cursor {
+    int segment;         // Form segment
+    int bar;             // Written bar
+    int event;           // Event
+    int event_beat;      // Beats elapsed within the event
+} t_play_cursor;
+
+// Compile the navigation flags of the written bars into a list of segments.
+// Returns the performed length in beats, or 0 on failure.
+int compile_form(const t_bar *bars, int num_bars,
+                 t_form_segment **segments, int *num_segments);
+
+#endif // FORM_H
@@ -0,0 +1,90 @@
+#ifndef MARKOV_H
+#define MARKOV_H
+
+#include "m_pd.h"
+#include "chord_data.h"
+#include "form.h"
+
+#define MARKOV_MAX_QUALITIES 256  // Distinct chord qualities (suffixes after the root)
+#define MARKOV_END 0xFFFF         // Separates progressions in the corpus
+#define MARKOV_MAX_CORPUS 16384   // Chords kept per object, later charts are not recorded
+
+// Result codes of markov_record
+enum {
+    MARKOV_FAILED,       // Out of memory
+    MARKOV_RECORDED,
+    MARKOV_DUPLICATE,    // The progression is already in the corpus
+    MARKOV_FULL          // The corpus would grow past MARKOV_MAX_CORPUS
+};
+
+// A chord is stored as (root << 8) | quality, a step between two chords as
+// (interval << 8) | quality, so transitions do not depend on the key.
+
+// Second order context: two chords and the interval between them
+typedef struct _markov_context {
+    unsigned int key;    // (quality << 12) | step, 0 = empty slot
+    int first;           // First outcome in second_urn
+    int count;           // Number of outcomes
+} t_markov_context;
+
+// A recorded progression, used to recognise charts that are loaded again
+typedef struct _markov_progression {
+    unsigned int hash;   // Hash of the chords and bar sizes
+    int start;           // First chord in the corpus
+    int length;          // Number of chords
+} t_markov_progression;
+
+typedef struct _markov {
+    // Corpus: every recorded progression in performed order
+    unsigned short *corpus;
+    int corpus_size;
+    int corpus_capacity;
+    unsigned char *bar_sizes;     // Chords per performed bar
+    int num_bar_sizes;
+    int bar_sizes_capacity;
+    int num_progressions;
+    t_markov_progression *progressions;
+    int progressions_capacity;
+    t_symbol **qualities;         // Chord qualities seen so far
+    int num_qualities;
+    int qualities_capacity;
+
+    // Transition tables: every row is an urn holding each observed outcome once per
+    // occurrence, so a uniform pick from the row samples the distribution in O(1)
+    unsigned short *starts;       // First chords
+    int num_starts;
+    int *first_rows;              // Row offsets into first_urn per quality, num_rows + 1
+    int num_rows;                 // Qualities known when the tables were built
+    unsigned short *first_urn;    // Steps following a quality
+    int first_size;
+    t_markov_context *contexts;   // Open addressing table of second order rows
+    int contexts_capacity;
+    unsigned short *second_urn;   // Steps following a context
+    int second_size;
+    int learned;                  // Tables are built
+} t_markov;
+
+void markov_init(t_markov *m);
+void markov_free(t_markov *m);
+
+// Forget the corpus and the tables
+void markov_clear(t_markov *m);
+
+// Add a chart, read through its performed form, to the corpus. A chart that is already
+// in the corpus is not added again. Returns one of MARKOV_*.
+int markov_record(t_markov *m, const t_chord_event *events, const t_bar *bars,
+                  const t_form_segment *segments, int num_segments);
+
+// Build the transition tables from the corpus. Returns the number of transitions.
+int markov_learn(t_markov *m);
+
+// Generate a progression of the given number of bars as chart tokens (chords and
+// bar lines). *seed is the random state and is advanced. Returns 0 on failure,
+// the caller frees the atoms.
+int markov_generate(t_markov *m, int bars, unsigned int *seed,
+                    t_atom **atoms, int *num_atoms);
+
+// Bytes held by the corpus and the tables
+int markov_footprint(const t_markov *m);
+
+#endif // MARKOV_H
@@ -3,6 +3,21 @@
 
 #include "m_pd.h"
 #include "chord_data.h"
+#include "form.h"
+#include "markov.h"
+
+// Arpeggiator modes
+enum {
+    ARP_OFF,
+    ARP_UP,
+    ARP_DOWN,
+    ARP_UPDOWN,
+    ARP_RANDOM,
+    ARP_PATTERN
+};
+
+#define ARP_MAX_PATTERN 32
+#define GROOVE_MAX_FEEL 16
 
 // Forward declarations
 struct _p_sheetmidi;
@@ -16,18 +31,88 @@ typedef struct _p_sheetmidi {
     t_object x_obj;
     t_p_sheetmidi_proxy p;  // Proxy for right inlet
     
-    t_float time_signature; // For validation during parsing only
+    t_float time_signature; // Beats per bar until the first inline meter
     t_chord_event *events;  // Array of chord events
     int num_events;         // Number of events
-    int total_duration;     // Total duration in beats
+    int events_capacity;    // Allocated events, the store grows by doubling
+    t_bar *bars;            // Array of written bars
+    int num_bars;           // Number of written bars
+    int bars_capacity;      // Allocated bars
+    int tick_unit;          // Note value the ticks of metered bars count (0 = no inline meter)
+    t_form_segment *segments; // Performed form as runs of written bars
+    int num_segments;       // Number of form segments
+    int total_duration;     // Total duration of the performed form in beats
+    int total_bars;         // Number of bars in the performed form
     int debug_enabled;      // Flag to control debug output
     
+    // Transposition members
+    int transpose;          // Semitones added to every output
+    int capo;               // Semitones the chord names are shifted down against the sound
+    t_spelling spelling;    // Pitch class names for respelled chord symbols
+    int spelling_key;       // Whether a key was given for the spelling
+    int spelling_version;   // Incremented whenever respelled symbols go stale
+    
+    // Voicing members
+    int voicing_low;        // Lowest note of the voicing range
+    int voicing_high;       // Highest note of the voicing range
+    int voicing_voices;     // Notes per voicing
+    
+    // Chord scale members
+    t_atom *scale_notes;    // Cached MIDI notes of the last scale output, allocated on first use
+    int scale_notes_count;  // Number of cached notes
+    int scale_notes_mask;   // Transposed mask the cache was built for (-1 = none)
+    
+    // Arpeggiator members
+    int arp_mode;           // ARP_* mode, ARP_OFF when not running
+    int arp_pattern[ARP_MAX_PATTERN]; // Note indices for ARP_PATTERN, negative = rest
+    int arp_pattern_len;    // Length of the custom pattern
+    int arp_rate;           // Steps per beat
+    t_float arp_gate;       // Note length as a fraction of a step
+    int arp_velocity;       // Note-on velocity
+    int arp_index;          // Step counter, kept across chord changes
+    int arp_steps_left;     // Steps still to play in the current beat
+    double arp_step_ms;     // Time between steps
+    int arp_note;           // Sounding note, -1 if none
+    t_clock *arp_clock;     // Schedules the steps within a beat
+    t_clock *arp_off_clock; // Schedules the note-off of the sounding note
+    double last_tick_time;  // Logical time of the previous tick
+    double tick_interval;   // Measured time between ticks in ms
+    int has_last_tick;      // Whether last_tick_time holds a tick, it can be at time 0
+    
     // Playback members
     t_outlet *note_outlet;     // Outlet for current note value
     t_outlet *list_outlet;     // Outlet for lists of notes
-    t_outlet *beat_outlet;     // Outlet for current beat position
+    t_outlet *beat_outlet;     // Outlet for current beat, bar and beat in bar
     t_outlet *debug_outlet;    // Outlet for chord symbols
+    t_outlet *info_outlet;     // Outlet for query replies ("remaining 2", "next Dm7 3", ...)
+    t_outlet *arp_outlet;      // Outlet for arpeggiator "note velocity" pairs
     int current_beat;          // Current playback position in beats
+    t_play_cursor cursor;      // Position of current_beat within the form
+    
+    // Groove members
+    t_float groove_swing;      // Percent of a tick pair taken by the first tick, 50 = straight
+    t_float groove_feel[GROOVE_MAX_FEEL]; // Percent of a tick late (early if negative) per beat of the bar
+    int groove_feel_len;       // Beats in the feel pattern, repeated through the bar
+    t_float anticipation;      // Percent of a tick anticipated chords come early
+    float *beat_offsets;       // Timing offset of every written beat in ticks, built with the chart
+    int offsets_capacity;      // Allocated offsets
+    
+    // Loop members
+    int loop_start_bar;        // First bar of the loop region (1-based), 0 = no loop
+    int loop_end_bar;          // Last bar of the loop region
+    int loop_start_beat;       // Boundaries of the loop region in beats, end exclusive
+    int loop_end_beat;
+    t_play_cursor loop_start_cursor; // Cursor at loop_start_beat
+    int loop_pending;          // A new region waits for the next bar line
+    int loop_next_start_bar;   // Region to apply at the next bar line
+    int loop_next_end_bar;
+    
+    // Generator members
+    t_markov markov;           // Corpus of loaded charts and chord transition tables
+    unsigned int generate_seed; // Random state of generate, advanced by every chord
+    
+    // Import members
+    t_canvas *canvas;          // Canvas the object lives in, import opens files relative to it
 } t_p_sheetmidi;
 
 #endif // P_SHEETMIDI_TYPES_H 
\ No newline at end of file
@@ -5,19 +5,33 @@
 #include "p_sheetmidi_types.h"
 
 typedef enum {
-    TOKEN_CHORD,    // Any chord symbol (C, Dm7, etc.)
-    TOKEN_DOT,      // . (hold)
-    TOKEN_BAR,      // | (bar separator)
-    TOKEN_ERROR     // Invalid token
+    TOKEN_CHORD,        // Any chord symbol (C, Dm7, etc.), >C anticipates the chord
+    TOKEN_DOT,          // . (hold)
+    TOKEN_BAR,          // | (bar separator)
+    TOKEN_REPEAT_START, // |: (bar separator opening a repeat)
+    TOKEN_REPEAT_END,   // :| (bar separator closing a repeat)
+    TOKEN_VOLTA,        // 1. 2. ... (first, second ending)
+    TOKEN_SEGNO,        // Segno
+    TOKEN_CODA,         // Coda
+    TOKEN_TO,           // To (as in "To Coda")
+    TOKEN_FINE,         // Fine
+    TOKEN_DA_CAPO,      // D.C.
+    TOKEN_DAL_SEGNO,    // D.S.
+    TOKEN_AL,           // al (as in "D.C. al Fine")
+    TOKEN_METER,        // 3/4, 7/8 ... (meter for the following bars)
+    TOKEN_ERROR         // Invalid token
 } token_type_t;
 
 typedef struct _token {
     token_type_t type;
-    t_symbol *value;      // Only used for TOKEN_CHORD
+    t_symbol *value;      // Symbol the token was read from
+    int number;           // Ending number, meter numerator or 1 for an anticipated chord
+    int unit;             // Meter denominator, only used for TOKEN_METER
 } token_t;
 
 // Function declarations
+token_t symbol_to_token(t_symbol *sym);
 token_t atom_to_token(t_atom *atom);
 int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *num_tokens);
 
-#endif // TOKEN_HANDLER_H 
\ No newline at end of file
+#endif // TOKEN_HANDLER_H 
@@ -0,0 +1,15 @@
+#ifndef VOICING_H
+#define VOICING_H
+
+#include "m_pd.h"
+#include "chord_data.h"
+
+#define MIN_VOICES 3
+
+// Choose a voicing for every event so that the total movement between consecutive
+// voicings is minimal. Notes stay within [low, high]. Results go to events[i].voicing.
+// Events before first keep their voicing and the line continues from it.
+void compute_voicings(t_chord_event *events, int num_events, int first,
+                      int low, int high, int voices);
+
+#endif // VOICING_H
@@ -0,0 +1,378 @@
+#include "m_pd.h"
+#include "markov.h"
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <stdio.h>
+
+void markov_init(t_markov *m) {
+    memset(m, 0, sizeof(t_markov));
+}
+
+// Free the transition tables, the corpus is kept
+static void free_tables(t_markov *m) {
+    if (m->starts) freebytes(m->starts, m->num_starts * sizeof(unsigned short));
+    if (m->first_rows) freebytes(m->first_rows, (m->num_rows + 1) * sizeof(int));
+    if (m->first_urn) freebytes(m->first_urn, m->first_size * sizeof(unsigned short));
+    if (m->contexts) freebytes(m->contexts, m->contexts_capacity * sizeof(t_markov_context));
+    if (m->second_urn) freebytes(m->second_urn, m->second_size * sizeof(unsigned short));
+    m->starts = NULL;
+    m->num_starts = 0;
+    m->first_rows = NULL;
+    m->num_rows = 0;
+    m->first_urn = NULL;
+    m->first_size = 0;
+    m->contexts = NULL;
+    m->contexts_capacity = 0;
+    m->second_urn = NULL;
+    m->second_size = 0;
+    m->learned = 0;
+}
+
+void markov_clear(t_markov *m) {
+    free_tables(m);
+    if (m->corpus) freebytes(m->corpus, m->corpus_capacity * sizeof(unsigned short));
+    if (m->bar_sizes) freebytes(m->bar_sizes, m->bar_sizes_capacity);
+    if (m->qualities) freebytes(m->qualities, m->qualities_capacity * sizeof(t_symbol *));
+    if (m->progressions) freebytes(m->progressions, m->progressions_capacity * sizeof(t_markov_progression));
+    markov_init(m);
+}
+
+void markov_free(t_markov *m) {
+    markov_clear(m);
+}
+
+int markov_footprint(const t_markov *m) {
+    return m->corpus_capacity * sizeof(unsigned short) + 
+           m->bar_sizes_capacity + 
+           m->qualities_capacity * sizeof(t_symbol *) + 
+           m->progressions_capacity * sizeof(t_markov_progression) + 
+           m->num_starts * sizeof(unsigned short) + 
+           (m->first_rows ? (m->num_rows + 1) * sizeof(int) : 0) + 
+           m->first_size * sizeof(unsigned short) + 
+           m->contexts_capacity * sizeof(t_markov_context) + 
+           m->second_size * sizeof(unsigned short);
+}
+
+// Grow an array by doubling its capacity
+static int grow(void **data, int *capacity, int needed, int size) {
+    if (needed <= *capacity) return 1;
+    int new_capacity = *capacity > 0 ? *capacity : 64;
+    while (new_capacity < needed) new_capacity *= 2;
+    void *grown = *data ? resizebytes(*data, *capacity * size, new_capacity * size)
+                        : getbytes(new_capacity * size);
+    if (!grown) return 0;
+    *data = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+// Chord quality: the symbol after the root, without a slash bass
+static int quality_index(t_markov *m, const t_chord_data *chord) {
+    const char *str = chord->original ? chord->original->s_name : "";
+    while (*str && (!isprint((unsigned char)*str) || isspace((unsigned char)*str))) str++;
+    if (!*str || !strchr("CDEFGAB", *str)) return -1;
+    str++;
+    if (*str == 'b' || *str == '#') str++;
+
+    char buf[MAXPDSTRING];
+    int len = 0;
+    while (str[len] && str[len] != '/' && len < MAXPDSTRING - 1) {
+        buf[len] = str[len];
+        len++;
+    }
+    buf[len] = '\0';
+    t_symbol *quality = gensym(buf);
+
+    for (int i = 0; i < m->num_qualities; i++) {
+        if (m->qualities[i] == quality) return i;
+    }
+    if (m->num_qualities >= MARKOV_MAX_QUALITIES ||
+        !grow((void **)&m->qualities, &m->qualities_capacity, m->num_qualities + 1, sizeof(t_symbol *))) {
+        return -1;
+    }
+    m->qualities[m->num_qualities] = quality;
+    return m->num_qualities++;
+}
+
+// Chord as recorded: root pitch class and quality index, -1 when it has no quality
+static int corpus_chord(t_markov *m, const t_chord_event *ev) {
+    int quality = quality_index(m, &ev->parsed);
+    if (quality < 0) return -1;
+    return (ev->parsed.root_offset % 12) << 8 | quality;
+}
+
+// FNV-1a hash of the chart as it would be recorded, chords and bar sizes in performed order
+static unsigned int hash_chart(t_markov *m, const t_chord_event *events, const t_bar *bars,
+                               const t_form_segment *segments, int num_segments, int *length) {
+    unsigned int hash = 2166136261u;
+    *length = 0;
+    for (int s = 0; s < num_segments; s++) {
+        for (int b = segments[s].start_bar; b < segments[s].end_bar; b++) {
+            const t_bar *bar = &bars[b];
+            unsigned char size = bar->num_events < 255 ? bar->num_events : 255;
+            hash = (hash ^ (0x10000u | size)) * 16777619u;
+            for (int e = bar->first_event; e < bar->first_event + bar->num_events; e++) {
+                int chord = corpus_chord(m, &events[e]);
+                if (chord < 0) continue;
+                hash = (hash ^ chord) * 16777619u;
+                (*length)++;
+            }
+        }
+    }
+    return hash;
+}
+
+// Whether a recorded progression holds the same chords as the chart
+static int same_chords(t_markov *m, const t_markov_progression *p, const t_chord_event *events,
+                       const t_bar *bars, const t_form_segment *segments, int num_segments) {
+    const unsigned short *chord = &m->corpus[p->start];
+    for (int s = 0; s < num_segments; s++) {
+        for (int b = segments[s].start_bar; b < segments[s].end_bar; b++) {
+            for (int e = bars[b].first_event; e < bars[b].first_event + bars[b].num_events; e++) {
+                int c = corpus_chord(m, &events[e]);
+                if (c >= 0 && c != *chord++) return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int markov_record(t_markov *m, const t_chord_event *events, const t_bar *bars,
+                  const t_form_segment *segments, int num_segments) {
+    if (!events || !bars || !segments || num_segments <= 0) return MARKOV_FAILED;
+
+    // Nothing to record when nothing was recorded or the same chart is already there,
+    // checked before appending so reloads don't grow the arrays
+    int length;
+    unsigned int hash = hash_chart(m, events, bars, segments, num_segments, &length);
+    if (length == 0) return MARKOV_RECORDED;
+    for (int i = 0; i < m->num_progressions; i++) {
+        const t_markov_progression *p = &m->progressions[i];
+        if (p->hash == hash && p->length == length &&
+            same_chords(m, p, events, bars, segments, num_segments)) {
+            return MARKOV_DUPLICATE;
+        }
+    }
+
+    int num_bars = 0;
+    for (int s = 0; s < num_segments; s++) num_bars += segments[s].end_bar - segments[s].start_bar;
+    if (m->corpus_size + length + 1 > MARKOV_MAX_CORPUS) return MARKOV_FULL;
+    if (!grow((void **)&m->corpus, &m->corpus_capacity, m->corpus_size + length + 1,
+              sizeof(unsigned short)) ||
+        !grow((void **)&m->bar_sizes, &m->bar_sizes_capacity, m->num_bar_sizes + num_bars, 1) ||
+        !grow((void **)&m->progressions, &m->progressions_capacity, m->num_progressions + 1,
+              sizeof(t_markov_progression))) {
+        return MARKOV_FAILED;
+    }
+
+    // Append the chart
+    int start = m->corpus_size;
+    for (int s = 0; s < num_segments; s++) {
+        for (int b = segments[s].start_bar; b < segments[s].end_bar; b++) {
+            const t_bar *bar = &bars[b];
+            m->bar_sizes[m->num_bar_sizes++] = bar->num_events < 255 ? bar->num_events : 255;
+            for (int e = bar->first_event; e < bar->first_event + bar->num_events; e++) {
+                int chord = corpus_chord(m, &events[e]);
+                if (chord >= 0) m->corpus[m->corpus_size++] = chord;
+            }
+        }
+    }
+    m->corpus[m->corpus_size++] = MARKOV_END;
+
+    t_markov_progression *p = &m->progressions[m->num_progressions++];
+    p->hash = hash;
+    p->start = start;
+    p->length = length;
+    return MARKOV_RECORDED;
+}
+
+static unsigned short step_between(unsigned short from, unsigned short to) {
+    int interval = ((to >> 8) - (from >> 8) + 12) % 12;
+    return interval << 8 | (to & 0xFF);
+}
+
+static unsigned int context_key(unsigned short from, unsigned short to) {
+    return ((unsigned int)(from & 0xFF) << 12 | step_between(from, to)) + 1;
+}
+
+static t_markov_context *find_context(const t_markov *m, unsigned int key) {
+    if (!m->contexts) return NULL;
+    unsigned int mask = m->contexts_capacity - 1;
+    for (unsigned int h = (key * 2654435761u) & mask; ; h = (h + 1) & mask) {
+        t_markov_context *c = &m->contexts[h];
+        if (c->key == key || c->key == 0) return c;
+    }
+}
+
+static int compare_pairs(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+int markov_learn(t_markov *m) {
+    free_tables(m);
+    if (m->num_progressions == 0) return 0;
+
+    // Count first chords and transitions
+    int num_first = 0;
+    int num_second = 0;
+    for (int i = 0; i < m->corpus_size; i++) {
+        if (m->corpus[i] == MARKOV_END) continue;
+        if (i == 0 || m->corpus[i - 1] == MARKOV_END) m->num_starts++;
+        if (m->corpus[i + 1] != MARKOV_END) {
+            num_first++;
+            if (m->corpus[i + 2] != MARKOV_END) num_second++;
+        }
+    }
+
+    m->starts = (unsigned short *)getbytes(m->num_starts * sizeof(unsigned short));
+    m->num_rows = m->num_qualities;
+    m->first_rows = (int *)getbytes((m->num_rows + 1) * sizeof(int));
+    m->first_size = num_first > 0 ? num_first : 1;
+    m->first_urn = (unsigned short *)getbytes(m->first_size * sizeof(unsigned short));
+    unsigned long long *pairs = (unsigned long long *)getbytes((num_second > 0 ? num_second : 1) *
+                                                               sizeof(unsigned long long));
+    if (!m->starts || !m->first_rows || !m->first_urn || !pairs) {
+        if (pairs) freebytes(pairs, (num_second > 0 ? num_second : 1) * sizeof(unsigned long long));
+        if (!m->first_urn) m->first_size = 0;
+        free_tables(m);
+        return 0;
+    }
+
+    // First order rows by counting sort on the quality of the current chord
+    int n = 0;
+    for (int i = 0; i < m->corpus_size; i++) {
+        if (m->corpus[i] == MARKOV_END) continue;
+        if (i == 0 || m->corpus[i - 1] == MARKOV_END) m->starts[n++] = m->corpus[i];
+        if (m->corpus[i + 1] != MARKOV_END) m->first_rows[(m->corpus[i] & 0xFF) + 1]++;
+    }
+    for (int q = 0; q < m->num_rows; q++) {
+        m->first_rows[q + 1] += m->first_rows[q];
+    }
+    int *fill = (int *)getbytes((m->num_rows + 1) * sizeof(int));
+    if (!fill) {
+        freebytes(pairs, (num_second > 0 ? num_second : 1) * sizeof(unsigned long long));
+        free_tables(m);
+        return 0;
+    }
+    n = 0;
+    for (int i = 0; i + 1 < m->corpus_size; i++) {
+        unsigned short a = m->corpus[i], b = m->corpus[i + 1];
+        if (a == MARKOV_END || b == MARKOV_END) continue;
+        int q = a & 0xFF;
+        m->first_urn[m->first_rows[q] + fill[q]++] = step_between(a, b);
+
+        unsigned short c = i + 2 < m->corpus_size ? m->corpus[i + 2] : MARKOV_END;
+        if (c != MARKOV_END) {
+            pairs[n++] = (unsigned long long)context_key(a, b) << 16 | step_between(b, c);
+        }
+    }
+    freebytes(fill, (m->num_rows + 1) * sizeof(int));
+
+    // Second order rows: sort by context, every run of equal keys becomes a row
+    qsort(pairs, n, sizeof(unsigned long long), compare_pairs);
+    int num_contexts = 0;
+    for (int i = 0; i < n; i++) {
+        if (i == 0 || (pairs[i] >> 16) != (pairs[i - 1] >> 16)) num_contexts++;
+    }
+    m->contexts_capacity = 16;
+    while (m->contexts_capacity < 2 * num_contexts) m->contexts_capacity *= 2;
+    m->contexts = (t_markov_context *)getbytes(m->contexts_capacity * sizeof(t_markov_context));
+    m->second_size = n > 0 ? n : 1;
+    m->second_urn = (unsigned short *)getbytes(m->second_size * sizeof(unsigned short));
+    if (!m->contexts || !m->second_urn) {
+        if (!m->contexts) m->contexts_capacity = 0;
+        if (!m->second_urn) m->second_size = 0;
+        freebytes(pairs, (num_second > 0 ? num_second : 1) * sizeof(unsigned long long));
+        free_tables(m);
+        return 0;
+    }
+    t_markov_context *row = NULL;
+    for (int i = 0; i < n; i++) {
+        unsigned int key = (unsigned int)(pairs[i] >> 16);
+        if (!row || row->key != key) {
+            row = find_context(m, key);
+            row->key = key;
+            row->first = i;
+        }
+        row->count++;
+        m->second_urn[i] = pairs[i] & 0xFFFF;
+    }
+    freebytes(pairs, (num_second > 0 ? num_second : 1) * sizeof(unsigned long long));
+
+    m->learned = 1;
+    return num_first;
+}
+
+// Uniform pick below n, from the high bits of a linear congruential generator
+static int pick(unsigned int *seed, int n) {
+    *seed = *seed * 1664525u + 1013904223u;
+    return (int)(((unsigned long long)*seed * (unsigned int)n) >> 32);
+}
+
+int markov_generate(t_markov *m, int bars, unsigned int *seed,
+                    t_atom **atoms, int *num_atoms) {
+    *atoms = NULL;
+    *num_atoms = 0;
+    if (!m->learned || bars <= 0 || m->num_starts == 0) return 0;
+
+    // Bar sizes are sampled from the corpus first, so the token count is known
+    unsigned char *sizes = (unsigned char *)getbytes(bars);
+    if (!sizes) return 0;
+    int count = bars - 1;
+    for (int i = 0; i < bars; i++) {
+        sizes[i] = m->num_bar_sizes > 0 ? m->bar_sizes[pick(seed, m->num_bar_sizes)] : 1;
+        count += sizes[i];
+    }
+    t_atom *out = (t_atom *)getbytes(count * sizeof(t_atom));
+    if (!out) {
+        freebytes(sizes, bars);
+        return 0;
+    }
+
+    t_spelling names;
+    build_spelling(NULL, names);
+    unsigned short prev = MARKOV_END;
+    unsigned short chord = MARKOV_END;
+    int n = 0;
+    for (int i = 0; i < bars; i++) {
+        if (i > 0) {
+            SETSYMBOL(&out[n], gensym("|"));
+            n++;
+        }
+        for (int j = 0; j < sizes[i]; j++) {
+            // Longest known context first, start over where the corpus never went on
+            unsigned short step = MARKOV_END;
+            t_markov_context *c = (prev != MARKOV_END) ? find_context(m, context_key(prev, chord)) : NULL;
+            if (c && c->count > 0) {
+                step = m->second_urn[c->first + pick(seed, c->count)];
+            } else if (chord != MARKOV_END) {
+                int q = chord & 0xFF;
+                int row_size = m->first_rows[q + 1] - m->first_rows[q];
+                if (row_size > 0) step = m->first_urn[m->first_rows[q] + pick(seed, row_size)];
+            }
+
+            unsigned short next;
+            if (step == MARKOV_END) {
+                next = m->starts[pick(seed, m->num_starts)];
+                prev = MARKOV_END;
+            } else {
+                next = (((chord >> 8) + (step >> 8)) % 12) << 8 | (step & 0xFF);
+                prev = chord;
+            }
+            chord = next;
+
+            char buf[MAXPDSTRING];
+            snprintf(buf, sizeof(buf), "%s%s", names[chord >> 8], m->qualities[chord & 0xFF]->s_name);
+            SETSYMBOL(&out[n], gensym(buf));
+            n++;
+        }
+    }
+    freebytes(sizes, bars);
+
+    *atoms = out;
+    *num_atoms = n;
+    return 1;
+}
@@ -3,9 +3,13 @@
 #include <ctype.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include "p_sheetmidi.h"
 #include "chord_data.h"
 #include "token_handler.h"
+#include "voicing.h"
+#include "analysis.h"
+#include "chart_import.h"
 #include "post_utils.h"
 
 EXTERN void pd_init(t_pd *x);
@@ -19,6 +23,9 @@ static void distribute_beats_in_bar(t_chord_event *events, int start_idx, int co
 static int parse_chord_sequence(t_p_sheetmidi *x, int argc, t_atom *argv);
 static void print_parsed_sequence(t_p_sheetmidi *x);
 static t_chord_event* get_current_event(t_p_sheetmidi *x);
+static t_play_cursor cursor_at(t_p_sheetmidi *x, int beat);
+static void seek_cursor(t_p_sheetmidi *x, int beat);
+static void advance_cursor(t_p_sheetmidi *x);
 static void output_debug_chord(t_p_sheetmidi *x, t_chord_event *ev);
 void p_sheetmidi_note(t_p_sheetmidi *x);
 void p_sheetmidi_tick(t_p_sheetmidi *x);
@@ -26,10 +33,6 @@ void p_sheetmidi_root(t_p_sheetmidi *x);
 void p_sheetmidi_third(t_p_sheetmidi *x);
 void p_sheetmidi_fifth(t_p_sheetmidi *x);
 
-// Add this to store the last sequence for reparsing
-static t_atom *last_sequence = NULL;
-static int last_sequence_size = 0;
-
 void p_sheetmidi_bang(t_p_sheetmidi *x) {
     if (x->num_events == 0) {
         info_post("SheetMidi: No chord sequence stored");
@@ -38,145 +41,327 @@ void p_sheetmidi_bang(t_p_sheetmidi *x) {
     print_parsed_sequence(x);
 }
 
-// Add function to output beat position
+// Add function to output beat position as "beat bar beat-in-bar offset-ms"
 static void output_beat_position(t_p_sheetmidi *x) {
-    outlet_float(x->beat_outlet, x->current_beat);
+    if (x->total_duration <= 0) {
+        outlet_float(x->beat_outlet, x->current_beat);
+        return;
+    }
+    
+    t_form_segment *seg = &x->segments[x->cursor.segment];
+    t_bar *bar = &x->bars[x->cursor.bar];
+    int written = x->events[x->cursor.event].start + x->cursor.event_beat;
+    
+    t_atom position[4];
+    SETFLOAT(&position[0], x->current_beat);
+    SETFLOAT(&position[1], seg->start_bar_number + (x->cursor.bar - seg->start_bar) + 1);
+    SETFLOAT(&position[2], written - bar->start + 1);
+    SETFLOAT(&position[3], x->beat_offsets ? x->beat_offsets[written] * x->tick_interval : 0);
+    outlet_list(x->beat_outlet, &s_list, 4, position);
 }
 
 // Add function to handle beat resetting
 static void reset_beat(t_p_sheetmidi *x, t_float new_beat) {
     if (x->total_duration > 0) {
         // Wrap around using modulo
-        x->current_beat = ((int)new_beat % x->total_duration + x->total_duration) % x->total_duration;
+        seek_cursor(x, ((int)new_beat % x->total_duration + x->total_duration) % x->total_duration);
         debug_post(x, "SheetMidi DEBUG: Beat reset to %d", x->current_beat);
         output_debug_chord(x, get_current_event(x));
     }
 }
 
-// Update proxy class to handle both symbol and list input
-void p_sheetmidi_proxy_anything(t_p_sheetmidi_proxy *p, t_symbol *s, int argc, t_atom *argv) {
-    if (!p || !p->x) return;
+// Helper function to find the beat where a bar of the performed form starts (0-based bar)
+static int bar_start_beat(t_p_sheetmidi *x, int n, t_bar **bar_out) {
+    // Last segment starting at or before the bar
+    int lo = 0, hi = x->num_segments - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (x->segments[mid].start_bar_number <= n) lo = mid;
+        else hi = mid - 1;
+    }
+    t_form_segment *seg = &x->segments[lo];
+    t_bar *bar = &x->bars[seg->start_bar + (n - seg->start_bar_number)];
+    if (bar_out) *bar_out = bar;
+    return seg->start_beat + (bar->start - x->bars[seg->start_bar].start);
+}
 
-    // Handle time signature changes
-    if (s == gensym("time")) {
-        if (argc > 0 && argv[0].a_type == A_FLOAT) {
-            t_float new_time_sig = atom_getfloat(&argv[0]);
-            if (new_time_sig != p->x->time_signature) {
-                p->x->time_signature = new_time_sig;
-                info_post("SheetMidi: Time signature set to %d", (int)p->x->time_signature);
-                
-                // Reparse last sequence if we have one
-                if (last_sequence && last_sequence_size > 0) {
-                    parse_chord_sequence(p->x, last_sequence_size, last_sequence);
-                    print_parsed_sequence(p->x);
-                }
-            }
-        }
-        return;
+// Move to a bar of the performed form (1-based) and a beat within it (1-based)
+static void reset_bar(t_p_sheetmidi *x, t_float new_bar, t_float new_beat) {
+    if (x->total_duration <= 0) return;
+    
+    int n = ((int)new_bar - 1) % x->total_bars;
+    if (n < 0) n += x->total_bars;
+    
+    t_bar *bar;
+    int start = bar_start_beat(x, n, &bar);
+    
+    int beat = new_beat >= 1 ? (int)new_beat - 1 : 0;  // Beat defaults to the first
+    if (bar->length > 0) {
+        beat = (beat % bar->length + bar->length) % bar->length;
     }
+    seek_cursor(x, start + beat);
+    debug_post(x, "SheetMidi DEBUG: Bar reset to %d, beat %d", n + 1, beat + 1);
+    output_debug_chord(x, get_current_event(x));
+}
 
-    // Handle beat reset
-    if (s == gensym("beat")) {
-        if (argc > 0 && argv[0].a_type == A_FLOAT) {
-            reset_beat(p->x, atom_getfloat(&argv[0]));
-        }
+// Helper function to compute the beat boundaries of the loop region,
+// the region is dropped if it no longer fits the form
+static void update_loop(t_p_sheetmidi *x) {
+    x->loop_start_beat = 0;
+    x->loop_end_beat = 0;
+    if (x->loop_start_bar <= 0 || x->total_duration <= 0) return;
+    
+    if (x->loop_end_bar > x->total_bars) x->loop_end_bar = x->total_bars;
+    if (x->loop_start_bar > x->loop_end_bar) {
+        info_post("SheetMidi: Loop region outside the form, loop off");
+        x->loop_start_bar = x->loop_end_bar = 0;
         return;
     }
+    
+    x->loop_start_beat = bar_start_beat(x, x->loop_start_bar - 1, NULL);
+    x->loop_end_beat = x->loop_end_bar < x->total_bars ? 
+        bar_start_beat(x, x->loop_end_bar, NULL) : x->total_duration;
+    
+    // Keep the cursor for the wrap so tick never has to search
+    x->loop_start_cursor = cursor_at(x, x->loop_start_beat);
+}
 
-    // For all other messages, tokenize and parse
-    token_t *tokens = NULL;
-    int num_tokens = 0;
+// Helper function to apply a loop region waiting for the bar line,
+// jumps into the region if playback is outside of it
+static void apply_pending_loop(t_p_sheetmidi *x) {
+    x->loop_pending = 0;
+    x->loop_start_bar = x->loop_next_start_bar;
+    x->loop_end_bar = x->loop_next_end_bar;
+    update_loop(x);
     
-    // Build complete string from selector and args
-    int buffer_size = 1024;
-    char *combined = (char *)getbytes(buffer_size);
-    if (!combined) {
-        info_post("SheetMidi: Failed to allocate memory for input string");
-        return;
+    if (x->loop_end_beat > 0 && 
+        (x->current_beat < x->loop_start_beat || x->current_beat >= x->loop_end_beat)) {
+        x->current_beat = x->loop_start_beat;
+        x->cursor = x->loop_start_cursor;
     }
+    debug_post(x, "SheetMidi DEBUG: Loop %d-%d active (beats %d-%d)", 
+         x->loop_start_bar, x->loop_end_bar, x->loop_start_beat, x->loop_end_beat);
+}
+
+// Helper function to get current event
+static t_chord_event* get_current_event(t_p_sheetmidi *x) {
+    if (x->num_events == 0 || x->total_duration <= 0) return NULL;
+    return &x->events[x->cursor.event];
+}
+
+// Cursor on a beat of the performed form
+static t_play_cursor cursor_at(t_p_sheetmidi *x, int beat) {
+    // Last segment starting at or before the beat
+    int lo = 0, hi = x->num_segments - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (x->segments[mid].start_beat <= beat) lo = mid;
+        else hi = mid - 1;
+    }
+    t_form_segment *seg = &x->segments[lo];
+    int written = x->bars[seg->start_bar].start + (beat - seg->start_beat);
     
-    // Start with selector
-    strncpy(combined, s->s_name, buffer_size - 1);
-    int pos = strlen(combined);
+    // Last event of the segment starting at or before the written beat
+    int first = x->bars[seg->start_bar].first_event;
+    t_bar *last_bar = &x->bars[seg->end_bar - 1];
+    int ev_lo = first, ev_hi = last_bar->first_event + last_bar->num_events - 1;
+    while (ev_lo < ev_hi) {
+        int mid = (ev_lo + ev_hi + 1) / 2;
+        if (x->events[mid].start <= written) ev_lo = mid;
+        else ev_hi = mid - 1;
+    }
     
-    // Add arguments
-    for (int i = 0; i < argc && pos < buffer_size - 2; i++) {  // -2 to ensure space for space and null
-        combined[pos++] = ' ';  // Always add a space before each argument
-        if (argv[i].a_type == A_SYMBOL) {
-            t_symbol *sym = atom_getsymbol(&argv[i]);
-            int len = strlen(sym->s_name);
-            if (pos + len < buffer_size - 1) {
-                strcpy(combined + pos, sym->s_name);
-                pos += len;
-            }
-        }
+    t_play_cursor c;
+    c.segment = lo;
+    c.event = ev_lo;
+    c.bar = x->events[ev_lo].bar;
+    c.event_beat = written - x->events[ev_lo].start;
+    return c;
+}
+
+// Place the cursor on a beat of the performed form
+static void seek_cursor(t_p_sheetmidi *x, int beat) {
+    if (x->num_segments == 0) return;
+    x->current_beat = beat;
+    x->cursor = cursor_at(x, beat);
+}
+
+// Move a cursor to the first beat of the next event, following the form
+static void next_event(t_p_sheetmidi *x, t_play_cursor *c) {
+    c->event_beat = 0;
+    c->event++;
+    t_bar *bar = &x->bars[c->bar];
+    if (c->event < bar->first_event + bar->num_events) return;
+    
+    c->bar++;
+    if (c->bar < x->segments[c->segment].end_bar) return;
+    
+    c->segment++;
+    if (c->segment >= x->num_segments) c->segment = 0;
+    c->bar = x->segments[c->segment].start_bar;
+    c->event = x->bars[c->bar].first_event;
+}
+
+// Move a cursor to the first beat of the previous event, following the form
+static void prev_event(t_p_sheetmidi *x, t_play_cursor *c) {
+    c->event_beat = 0;
+    c->event--;
+    if (c->event >= x->bars[c->bar].first_event) return;
+    
+    c->bar--;
+    if (c->bar < x->segments[c->segment].start_bar) {
+        c->segment--;
+        if (c->segment < 0) c->segment = x->num_segments - 1;
+        c->bar = x->segments[c->segment].end_bar - 1;
     }
-    combined[pos] = '\0';
+    c->event = x->bars[c->bar].first_event + x->bars[c->bar].num_events - 1;
+}
+
+// Step a copy of the playback cursor by k events (negative k steps back), skipping
+// events without beats and wrapping inside the loop region like playback does.
+// Sets *beats to the distance in beats between the current beat and the start of
+// the reached event.
+static t_play_cursor step_cursor(t_p_sheetmidi *x, int k, int *beats) {
+    t_play_cursor c = x->cursor;
+    int loop = x->loop_end_beat > 0;
+    int start = x->current_beat - c.event_beat;  // Performed beat the event starts on
+    *beats = -c.event_beat;
+    c.event_beat = 0;
     
-    // First convert string to tokens
-    if (tokenize_string(p->x, combined, &tokens, &num_tokens)) {
-        // Convert tokens to atoms for storage
-        if (last_sequence) {
-            freebytes(last_sequence, last_sequence_size * sizeof(t_atom));
-        }
-        last_sequence = (t_atom *)getbytes(num_tokens * sizeof(t_atom));
-        last_sequence_size = num_tokens;
-        
-        for (int i = 0; i < num_tokens; i++) {
-            if (tokens[i].type == TOKEN_CHORD) {
-                SETSYMBOL(&last_sequence[i], tokens[i].value);
-            } else if (tokens[i].type == TOKEN_BAR) {
-                SETSYMBOL(&last_sequence[i], gensym("|"));
-            } else if (tokens[i].type == TOKEN_DOT) {
-                SETSYMBOL(&last_sequence[i], gensym("."));
-            }
+    while (k > 0) {
+        *beats += x->events[c.event].duration;
+        start += x->events[c.event].duration;
+        if (loop && start == x->loop_end_beat) {
+            c = x->loop_start_cursor;
+            start = x->loop_start_beat;
+        } else {
+            next_event(x, &c);
+            if (start >= x->total_duration) start = 0;
         }
-
-        if (parse_chord_sequence(p->x, num_tokens, last_sequence)) {
-            print_parsed_sequence(p->x);
+        if (x->events[c.event].duration > 0) k--;
+    }
+    while (k < 0) {
+        if (loop && start == x->loop_start_beat) {
+            // The chord before the loop start is the last one of the region
+            c = cursor_at(x, x->loop_end_beat - 1);
+            start = x->loop_end_beat - 1 - c.event_beat;
+            c.event_beat = 0;
+        } else {
+            prev_event(x, &c);
+            start -= x->events[c.event].duration;
+            if (start < 0) start += x->total_duration;
         }
-        
-        freebytes(tokens, num_tokens * sizeof(token_t));
+        *beats -= x->events[c.event].duration;
+        if (x->events[c.event].duration > 0) k++;
     }
-    
-    freebytes(combined, buffer_size);
+    return c;
 }
 
-// Helper function to get current event
-static t_chord_event* get_current_event(t_p_sheetmidi *x) {
-    if (x->num_events == 0) return NULL;
+// Advance the cursor by one beat
+static void advance_cursor(t_p_sheetmidi *x) {
+    // Wrap inside the loop region
+    if (x->loop_end_beat > 0 && x->current_beat + 1 == x->loop_end_beat) {
+        x->current_beat = x->loop_start_beat;
+        x->cursor = x->loop_start_cursor;
+        return;
+    }
     
-    int beat_count = 0;
-    int event_idx = 0;
+    x->current_beat++;
+    if (x->current_beat >= x->total_duration) {
+        x->current_beat = 0;
+    }
     
-    while (beat_count + x->events[event_idx].duration <= x->current_beat) {
-        beat_count += x->events[event_idx].duration;
-        event_idx++;
-        if (event_idx >= x->num_events) {
-            x->current_beat = 0;
-            beat_count = 0;
-            event_idx = 0;
-        }
+    x->cursor.event_beat++;
+    while (x->cursor.event_beat >= x->events[x->cursor.event].duration) {
+        next_event(x, &x->cursor);
     }
+}
+
+// Helper function to get the transposed root of a chord (0-11), only the pitch class
+// moves so whole octaves of transposition leave the notes unchanged
+static int transposed_root(t_p_sheetmidi *x, t_chord_data *chord) {
+    return ((chord->root_offset + x->transpose) % 12 + 12) % 12;
+}
+
+// Helper function to get the chord symbol spelled for the current transposition,
+// respelled symbols are made on first request and kept until the transposition changes
+static t_symbol *spelled_chord(t_p_sheetmidi *x, t_chord_event *ev) {
+    int semitones = x->transpose - x->capo;
+    if (semitones % 12 == 0 && !x->spelling_key) return ev->chord;
     
-    return &x->events[event_idx];
+    if (!ev->spelled || ev->spelled_version != x->spelling_version) {
+        ev->spelled = spell_chord_symbol(&ev->parsed, semitones, x->spelling);
+        ev->spelled_version = x->spelling_version;
+    }
+    return ev->spelled;
 }
 
 // Helper function to output debug info
 static void output_debug_chord(t_p_sheetmidi *x, t_chord_event *ev) {
     if (ev && ev->chord) {
-        outlet_symbol(x->debug_outlet, ev->chord);
+        outlet_symbol(x->debug_outlet, spelled_chord(x, ev));
     }
 }
 
 // Helper function to clear events
 static void clear_events(t_p_sheetmidi *x) {
+    // The event and bar arrays are kept for the next chart, so reloading doesn't reallocate
+    x->num_events = 0;
+    x->total_duration = 0;
+    x->num_bars = 0;
+    if (x->segments) {
+        freebytes(x->segments, x->num_segments * sizeof(t_form_segment));
+        x->segments = NULL;
+        x->num_segments = 0;
+    }
+    x->total_bars = 0;
+    x->tick_unit = 0;
+}
+
+// Helper function to release the event, bar and offset arrays
+static void free_store(t_p_sheetmidi *x) {
+    clear_events(x);
+    if (x->beat_offsets) {
+        freebytes(x->beat_offsets, x->offsets_capacity * sizeof(float));
+        x->beat_offsets = NULL;
+        x->offsets_capacity = 0;
+    }
     if (x->events) {
-        freebytes(x->events, x->num_events * sizeof(t_chord_event));
+        freebytes(x->events, x->events_capacity * sizeof(t_chord_event));
         x->events = NULL;
-        x->num_events = 0;
-        x->total_duration = 0;
+        x->events_capacity = 0;
+    }
+    if (x->bars) {
+        freebytes(x->bars, x->bars_capacity * sizeof(t_bar));
+        x->bars = NULL;
+        x->bars_capacity = 0;
+    }
+}
+
+// Helper function to make room for more events and bars, the store grows by doubling
+static int reserve_store(t_p_sheetmidi *x, int more_events, int more_bars) {
+    if (x->num_events + more_events > x->events_capacity) {
+        int capacity = x->events_capacity > 0 ? x->events_capacity : 16;
+        while (capacity < x->num_events + more_events) capacity *= 2;
+        t_chord_event *events = x->events
+            ? (t_chord_event *)resizebytes(x->events, x->events_capacity * sizeof(t_chord_event),
+                                           capacity * sizeof(t_chord_event))
+            : (t_chord_event *)getbytes(capacity * sizeof(t_chord_event));
+        if (!events) return 0;
+        x->events = events;
+        x->events_capacity = capacity;
+    }
+    if (x->num_bars + more_bars > x->bars_capacity) {
+        int capacity = x->bars_capacity > 0 ? x->bars_capacity : 16;
+        while (capacity < x->num_bars + more_bars) capacity *= 2;
+        t_bar *bars = x->bars
+            ? (t_bar *)resizebytes(x->bars, x->bars_capacity * sizeof(t_bar), capacity * sizeof(t_bar))
+            : (t_bar *)getbytes(capacity * sizeof(t_bar));
+        if (!bars) return 0;
+        x->bars = bars;
+        x->bars_capacity = capacity;
     }
+    return 1;
 }
 
 // Helper function to distribute beats in a bar
@@ -194,13 +379,37 @@ static void distribute_beats_in_bar(t_chord_event *events, int start_idx, int co
     }
 }
 
-// Parse a sequence of chord tokens into events
-static int parse_chord_sequence(t_p_sheetmidi *x, int argc, t_atom *argv) {
+// Helper function to finalize the durations of a bar
+static void finish_bar(t_p_sheetmidi *x, t_bar *bar, int bar_has_dots, int current_chord_dots) {
+    bar->dotted = bar_has_dots;
+    if (bar_has_dots) {
+        x->events[bar->first_event + bar->num_events - 1].duration = 1 + current_chord_dots;
+        debug_post(x, "SheetMidi DEBUG: Bar with dots - final chord duration %d", 
+             x->events[bar->first_event + bar->num_events - 1].duration);
+    } else {
+        debug_post(x, "SheetMidi DEBUG: Bar without dots - distributing beats among %d chords", 
+             bar->num_events);
+        distribute_beats_in_bar(x->events, bar->first_event, 
+                             bar->num_events, bar->meter);
+    }
+}
+
+// Helper function to attach an end-of-bar marker to the latest bar parsed since first_bar
+static void mark_last_bar(t_p_sheetmidi *x, int first_bar, int flag, const char *name) {
+    if (x->num_bars == first_bar) {
+        info_post("SheetMidi: %s before the first bar ignored", name);
+        return;
+    }
+    x->bars[x->num_bars - 1].flags |= flag;
+    debug_post(x, "SheetMidi DEBUG: %s at bar %d", name, x->num_bars - first_bar);
+}
+
+// Parse chord tokens into bars appended to the end of the store, bars start in the
+// given meter. Returns the number of bars added; on error the store is left unchanged.
+static int parse_bars(t_p_sheetmidi *x, int argc, t_atom *argv, int meter, int meter_unit) {
     if (!x || !argv || argc <= 0) return 0;
     
-    clear_events(x);
-    
-    // First pass: count actual events (chords only, not dots)
+    // First pass: count actual events (chords only, not dots or navigation)
     int num_events = 0;
     for (int i = 0; i < argc; i++) {
         token_t token = atom_to_token(&argv[i]);
@@ -208,54 +417,81 @@ static int parse_chord_sequence(t_p_sheetmidi *x, int argc, t_atom *argv) {
             num_events++;
         }
     }
+    if (num_events == 0) {
+        info_post("SheetMidi: No chords in sequence");
+        return 0;
+    }
     
-    // Allocate events array
-    x->events = (t_chord_event *)getbytes(num_events * sizeof(t_chord_event));
-    if (!x->events) {
+    // Make room, every bar holds at least one event
+    if (!reserve_store(x, num_events, num_events)) {
         info_post("SheetMidi: Failed to allocate memory for events");
         return 0;
     }
-    x->num_events = num_events;
+    int first_event = x->num_events;
+    int first_bar = x->num_bars;
     
-    // Second pass: create events and handle dots
-    int event_idx = 0;
-    int current_bar_start = 0;
+    // Second pass: create events and bars, handle dots and navigation
     int chords_in_current_bar = 0;
     int current_chord_dots = 0;  // Dots for current chord being processed
     int bar_has_dots = 0;       // Whether current bar uses dot notation
+    int pending_flags = 0;      // Start-of-bar markers for the next bar
+    int pending_volta = 0;      // Ending number for the next bar
+    token_type_t prefix = TOKEN_ERROR;  // Preceding "al" or "To"
     t_symbol *last_chord = NULL;
     
     debug_post(x, "SheetMidi DEBUG: Starting second pass parsing");
     
     for (int i = 0; i < argc; i++) {
         token_t token = atom_to_token(&argv[i]);
+        token_type_t token_prefix = prefix;
+        prefix = TOKEN_ERROR;
         
         switch (token.type) {
             case TOKEN_CHORD:
                 // If we had a previous chord in this bar, finalize its duration
                 if (last_chord && chords_in_current_bar > 0) {
                     if (bar_has_dots) {
-                        x->events[event_idx - 1].duration = 1 + current_chord_dots;
+                        x->events[x->num_events - 1].duration = 1 + current_chord_dots;
                         debug_post(x, "SheetMidi DEBUG: Set previous chord duration to %d (1 + %d dots)", 
-                             x->events[event_idx - 1].duration, current_chord_dots);
+                             x->events[x->num_events - 1].duration, current_chord_dots);
                     }
                 }
                 
-                // Add new chord event
-                x->events[event_idx].chord = token.value;
-                x->events[event_idx].parsed = parse_chord_symbol(token.value);
-                x->events[event_idx].duration = 1;  // Default duration, may be modified later
-                last_chord = token.value;
+                // First chord opens a new bar
+                if (chords_in_current_bar == 0) {
+                    t_bar *bar = &x->bars[x->num_bars++];
+                    memset(bar, 0, sizeof(t_bar));
+                    bar->first_event = x->num_events;
+                    bar->flags = pending_flags;
+                    bar->volta = pending_volta;
+                    bar->meter = meter;
+                    bar->meter_unit = meter_unit;
+                    pending_flags = 0;
+                    pending_volta = 0;
+                }
+                
+                // Add new chord event, the slot may hold a deleted event
+                t_chord_event *ev = &x->events[x->num_events++];
+                memset(ev, 0, sizeof(t_chord_event));
+                // An anticipated chord is stored without its > marker
+                ev->anticipated = token.number;
+                ev->chord = ev->anticipated ? gensym(token.value->s_name + 1) : token.value;
+                ev->parsed = parse_chord_symbol(ev->chord);
+                ev->scale = chord_scale(&ev->parsed, &ev->scale_mask);
+                ev->duration = 1;  // Default duration, may be modified later
+                ev->bar = x->num_bars - 1;
+                x->bars[x->num_bars - 1].num_events++;
+                last_chord = ev->chord;
                 current_chord_dots = 0;  // Reset dot count for new chord
                 chords_in_current_bar++;
-                event_idx++;
-                debug_post(x, "SheetMidi DEBUG: Added chord %s at index %d", token.value->s_name, event_idx - 1);
+                debug_post(x, "SheetMidi DEBUG: Added chord %s at index %d", ev->chord->s_name, x->num_events - 1);
                 break;
                 
             case TOKEN_DOT:
                 if (!last_chord) {
                     info_post("SheetMidi: Dot without preceding chord");
-                    clear_events(x);
+                    x->num_events = first_event;
+                    x->num_bars = first_bar;
                     return 0;
                 }
                 current_chord_dots++;
@@ -265,62 +501,574 @@ static int parse_chord_sequence(t_p_sheetmidi *x, int argc, t_atom *argv) {
                 break;
                 
             case TOKEN_BAR:
+            case TOKEN_REPEAT_START:
+            case TOKEN_REPEAT_END:
                 if (chords_in_current_bar > 0) {
                     // Finalize last chord in bar
-                    if (bar_has_dots) {
-                        x->events[event_idx - 1].duration = 1 + current_chord_dots;
-                        debug_post(x, "SheetMidi DEBUG: Bar with dots - final chord duration %d", 
-                             x->events[event_idx - 1].duration);
-                    } else {
-                        debug_post(x, "SheetMidi DEBUG: Bar without dots - distributing beats among %d chords", 
-                             chords_in_current_bar);
-                        distribute_beats_in_bar(x->events, current_bar_start, 
-                                             chords_in_current_bar, x->time_signature);
-                    }
+                    finish_bar(x, &x->bars[x->num_bars - 1], bar_has_dots, current_chord_dots);
                     
                     // Reset for next bar
-                    current_bar_start = event_idx;
                     chords_in_current_bar = 0;
                     current_chord_dots = 0;
                     bar_has_dots = 0;
                     debug_post(x, "SheetMidi DEBUG: Bar marker - resetting counters");
                 }
+                if (token.type == TOKEN_REPEAT_END) {
+                    mark_last_bar(x, first_bar, BAR_REPEAT_END, ":|");
+                } else if (token.type == TOKEN_REPEAT_START) {
+                    pending_flags |= BAR_REPEAT_START;
+                }
+                break;
+                
+            case TOKEN_VOLTA:
+                pending_volta = token.number;
+                debug_post(x, "SheetMidi DEBUG: Ending %d starts at bar %d", 
+                     token.number, x->num_bars - first_bar + (chords_in_current_bar > 0 ? 1 : 0));
+                break;
+                
+            case TOKEN_METER:
+                meter = token.number;
+                meter_unit = token.unit;
+                debug_post(x, "SheetMidi DEBUG: Meter %d/%d from bar %d", 
+                     meter, meter_unit, x->num_bars - first_bar + (chords_in_current_bar > 0 ? 2 : 1));
+                break;
+                
+            case TOKEN_SEGNO:
+                pending_flags |= BAR_SEGNO;
+                break;
+                
+            case TOKEN_CODA:
+                if (token_prefix == TOKEN_AL) {
+                    mark_last_bar(x, first_bar, BAR_AL_CODA, "al Coda");
+                } else if (token_prefix == TOKEN_TO) {
+                    mark_last_bar(x, first_bar, BAR_TO_CODA, "To Coda");
+                } else {
+                    pending_flags |= BAR_CODA;
+                }
+                break;
+                
+            case TOKEN_FINE:
+                mark_last_bar(x, first_bar, token_prefix == TOKEN_AL ? BAR_AL_FINE : BAR_FINE, 
+                              token_prefix == TOKEN_AL ? "al Fine" : "Fine");
+                break;
+                
+            case TOKEN_DA_CAPO:
+                mark_last_bar(x, first_bar, BAR_DA_CAPO, "D.C.");
+                break;
+                
+            case TOKEN_DAL_SEGNO:
+                mark_last_bar(x, first_bar, BAR_DAL_SEGNO, "D.S.");
+                break;
+                
+            case TOKEN_AL:
+            case TOKEN_TO:
+                prefix = token.type;
                 break;
                 
             case TOKEN_ERROR:
                 debug_post(x, "SheetMidi DEBUG: Error token encountered");
-                clear_events(x);
+                x->num_events = first_event;
+                x->num_bars = first_bar;
                 return 0;
         }
     }
-    
-    // Handle last bar if it wasn't terminated
-    if (chords_in_current_bar > 0) {
-        if (bar_has_dots) {
-            x->events[event_idx - 1].duration = 1 + current_chord_dots;
-            debug_post(x, "SheetMidi DEBUG: Final bar (with dots) - last chord duration %d", 
-                 x->events[event_idx - 1].duration);
-        } else {
-            debug_post(x, "SheetMidi DEBUG: Final bar (without dots) - distributing beats among %d chords", 
-                 chords_in_current_bar);
-            distribute_beats_in_bar(x->events, current_bar_start, 
-                                  chords_in_current_bar, x->time_signature);
+    
+    // Handle last bar if it wasn't terminated
+    if (chords_in_current_bar > 0) {
+        debug_post(x, "SheetMidi DEBUG: Finalizing unterminated last bar");
+        finish_bar(x, &x->bars[x->num_bars - 1], bar_has_dots, current_chord_dots);
+    }
+    
+    return x->num_bars - first_bar;
+}
+
+// Build the timing offset of every written beat from the groove settings and the
+// anticipated chords, so ticks only look the offset up. Only the bars from first_bar to
+// last_bar (exclusive) are built, the offsets of the bars after them move from old_tail.
+static void build_offsets(t_p_sheetmidi *x, int first_bar, int last_bar, int old_tail) {
+    if (x->num_bars == 0) return;
+    if (!x->beat_offsets) {
+        first_bar = 0;
+        last_bar = x->num_bars;
+    }
+    
+    t_bar *last = &x->bars[x->num_bars - 1];
+    int beats = last->start + last->length;
+    if (beats > x->offsets_capacity) {
+        int capacity = x->offsets_capacity > 0 ? x->offsets_capacity : 64;
+        while (capacity < beats) capacity *= 2;
+        float *offsets = x->beat_offsets
+            ? (float *)resizebytes(x->beat_offsets, x->offsets_capacity * sizeof(float), capacity * sizeof(float))
+            : (float *)getbytes(capacity * sizeof(float));
+        if (!offsets) {
+            info_post("SheetMidi: Failed to allocate memory for timing offsets");
+            if (x->beat_offsets) freebytes(x->beat_offsets, x->offsets_capacity * sizeof(float));
+            x->beat_offsets = NULL;
+            x->offsets_capacity = 0;
+            return;
+        }
+        x->beat_offsets = offsets;
+        x->offsets_capacity = capacity;
+    }
+    if (last_bar < x->num_bars) {
+        int tail = x->bars[last_bar].start;
+        memmove(x->beat_offsets + tail, x->beat_offsets + old_tail, (beats - tail) * sizeof(float));
+    }
+    if (first_bar >= last_bar) return;
+    
+    // Swing delays every second beat of the bar, the feel pattern repeats through the bar
+    float swing = 2 * x->groove_swing / 100 - 1;
+    for (int b = first_bar; b < last_bar; b++) {
+        t_bar *bar = &x->bars[b];
+        for (int j = 0; j < bar->length; j++) {
+            float offset = (j % 2) ? swing : 0;
+            if (x->groove_feel_len > 0) offset += x->groove_feel[j % x->groove_feel_len] / 100;
+            x->beat_offsets[bar->start + j] = offset;
+        }
+    }
+    int end = x->bars[last_bar - 1].first_event + x->bars[last_bar - 1].num_events;
+    for (int i = x->bars[first_bar].first_event; i < end; i++) {
+        t_chord_event *ev = &x->events[i];
+        if (ev->anticipated && ev->duration > 0) x->beat_offsets[ev->start] -= x->anticipation / 100;
+    }
+}
+
+// Helper function to give the bars with their own meter their length in ticks. When the
+// chart mixes note values, ticks count the shortest one, e.g. eighths for 7/8 into 4/4,
+// so a 4/4 bar lasts 8 ticks and 6/8 lasts as long as 3/4. Only the bars from first_bar
+// to last_bar are distributed unless the tick unit changes, then every metered bar is
+// and 1 is returned.
+static int apply_meters(t_p_sheetmidi *x, int first_bar, int last_bar) {
+    int tick_unit = 0;
+    for (int i = 0; i < x->num_bars; i++) {
+        if (x->bars[i].meter_unit > tick_unit) tick_unit = x->bars[i].meter_unit;
+    }
+    int changed = tick_unit != x->tick_unit;
+    if (changed) {
+        x->tick_unit = tick_unit;
+        first_bar = 0;
+        last_bar = x->num_bars;
+    }
+    if (tick_unit == 0) return changed;
+    
+    // first_event of the new bars is set by the layout that follows
+    int event = first_bar > 0 ? x->bars[first_bar - 1].first_event + x->bars[first_bar - 1].num_events : 0;
+    for (int i = first_bar; i < last_bar; event += x->bars[i].num_events, i++) {
+        t_bar *bar = &x->bars[i];
+        if (bar->meter_unit == 0 || bar->dotted) continue;
+        if (tick_unit % bar->meter_unit != 0) {
+            info_post("SheetMidi: %d/%d doesn't divide into 1/%d ticks, bar %d is rounded", 
+                      bar->meter, bar->meter_unit, tick_unit, i + 1);
+        }
+        int ticks = bar->meter * tick_unit / bar->meter_unit;
+        distribute_beats_in_bar(x->events, event, bar->num_events, ticks > 0 ? ticks : 1);
+    }
+    return changed;
+}
+
+// Rebuild everything derived from the written bars after the bars from first_bar to
+// last_bar (exclusive) were written: layout, form, voicings, timing offsets and harmonic
+// analysis. The bars before them are kept as laid out, the bars after them only moved
+// and are shifted. Voicings of events before first_voiced are kept.
+static int rebuild_chart(t_p_sheetmidi *x, int first_bar, int last_bar, int first_voiced) {
+    int old_tail = last_bar < x->num_bars ? x->bars[last_bar].start : 0;
+    if (apply_meters(x, first_bar, last_bar)) {
+        first_bar = 0;
+        last_bar = x->num_bars;
+    }
+    
+    // Lay out the written chart from the first new bar
+    t_bar *prev = first_bar > 0 ? &x->bars[first_bar - 1] : NULL;
+    int beat = prev ? prev->start + prev->length : 0;
+    int event = prev ? prev->first_event + prev->num_events : 0;
+    for (int i = first_bar; i < x->num_bars; i++) {
+        t_bar *bar = &x->bars[i];
+        bar->first_event = event;
+        bar->start = beat;
+        for (int j = 0; j < bar->num_events; j++, event++) {
+            x->events[event].bar = i;
+            x->events[event].start = beat;
+            beat += x->events[event].duration;
+        }
+        bar->length = beat - bar->start;
+    }
+    
+    // Compile repeats and navigation into the performed form, a jump anywhere can
+    // change the whole form so it is compiled from the start
+    if (x->segments) {
+        freebytes(x->segments, x->num_segments * sizeof(t_form_segment));
+        x->segments = NULL;
+        x->num_segments = 0;
+    }
+    x->total_duration = compile_form(x->bars, x->num_bars, &x->segments, &x->num_segments);
+    if (x->total_duration <= 0) {
+        info_post("SheetMidi: Sequence has no playable beats");
+        clear_events(x);
+        return 0;
+    }
+    t_form_segment *last_segment = &x->segments[x->num_segments - 1];
+    x->total_bars = last_segment->start_bar_number + last_segment->end_bar - last_segment->start_bar;
+    
+    // Voice lead through the progression once, playback only reads the result
+    compute_voicings(x->events, x->num_events, first_voiced, 
+                     x->voicing_low, x->voicing_high, x->voicing_voices);
+    
+    // Label keys and functions, the function and key queries only read the labels
+    analyze_harmony(x->events, x->num_events, 
+                    first_bar < x->num_bars ? x->bars[first_bar].first_event : x->num_events,
+                    last_bar < x->num_bars ? x->bars[last_bar].first_event : x->num_events);
+    build_offsets(x, first_bar, last_bar, old_tail);
+    
+    debug_post(x, "SheetMidi DEBUG: Parsing complete - %d events in %d bars, %d form segments, total duration %d beats", 
+         x->num_events, x->num_bars, x->num_segments, x->total_duration);
+    return 1;
+}
+
+// Helper function to put the playback position back on a written bar after an edit,
+// preferring the form segment it was played from
+static void restore_position(t_p_sheetmidi *x, int bar, int beat_in_bar, int segment) {
+    if (bar < 0 || bar >= x->num_bars) {
+        bar = 0;
+        beat_in_bar = 0;
+    }
+    if (segment < 0 || segment >= x->num_segments || 
+        bar < x->segments[segment].start_bar || bar >= x->segments[segment].end_bar) {
+        segment = -1;
+        for (int i = 0; i < x->num_segments && segment < 0; i++) {
+            if (bar >= x->segments[i].start_bar && bar < x->segments[i].end_bar) segment = i;
+        }
+    }
+    if (segment < 0) {
+        // Bar is never played, e.g. an ending that is skipped
+        seek_cursor(x, 0);
+        return;
+    }
+    
+    t_bar *b = &x->bars[bar];
+    if (beat_in_bar >= b->length) beat_in_bar = b->length - 1;
+    if (beat_in_bar < 0) beat_in_bar = 0;
+    t_form_segment *seg = &x->segments[segment];
+    seek_cursor(x, seg->start_beat + b->start - x->bars[seg->start_bar].start + beat_in_bar);
+}
+
+// Parse a complete sequence of chord tokens, replacing the stored chart
+static int parse_chord_sequence(t_p_sheetmidi *x, int argc, t_atom *argv) {
+    if (!x || !argv || argc <= 0) return 0;
+    
+    clear_events(x);
+    if (!parse_bars(x, argc, argv, x->time_signature, 0) || !rebuild_chart(x, 0, x->num_bars, 0)) {
+        clear_events(x);
+        return 0;
+    }
+    
+    // Keep the playback position if it still fits
+    seek_cursor(x, x->current_beat < x->total_duration ? x->current_beat : 0);
+    update_loop(x);
+    
+    // Output initial beat position after parsing
+    output_beat_position(x);
+    
+    return 1;
+}
+
+// Replace remove written bars from bar at on with the bars parsed from the tokens,
+// remove < 0 replaces as many bars as were parsed. Only the new bars are parsed.
+static int edit_bars(t_p_sheetmidi *x, int at, int remove, int argc, t_atom *argv) {
+    if (at < 0) at = 0;
+    if (at > x->num_bars) at = x->num_bars;
+    
+    // Remember the playback position by written bar
+    int pos_bar = -1, pos_beat = 0, pos_segment = -1;
+    if (x->total_duration > 0) {
+        pos_bar = x->cursor.bar;
+        pos_beat = x->events[x->cursor.event].start + x->cursor.event_beat - x->bars[pos_bar].start;
+        pos_segment = x->cursor.segment;
+    }
+    
+    int old_events = x->num_events;
+    int old_bars = x->num_bars;
+    int added = 0;
+    if (argc > 0) {
+        // New bars continue in the meter of the bar before them
+        int meter = at > 0 ? x->bars[at - 1].meter : x->time_signature;
+        int meter_unit = at > 0 ? x->bars[at - 1].meter_unit : 0;
+        added = parse_bars(x, argc, argv, meter, meter_unit);
+        if (!added) return 0;
+    }
+    if (remove < 0) remove = added;
+    if (remove > old_bars - at) remove = old_bars - at;
+    
+    // Events covered by the bars being replaced
+    int event_at = at < old_bars ? x->bars[at].first_event : old_events;
+    int removed_events = 0;
+    for (int i = at; i < at + remove; i++) {
+        removed_events += x->bars[i].num_events;
+    }
+    int added_events = x->num_events - old_events;
+    
+    // The new bars were parsed at the end of the store, rotate them into place
+    if (added > 0 && at + remove < old_bars) {
+        t_chord_event *new_events = (t_chord_event *)getbytes(added_events * sizeof(t_chord_event));
+        t_bar *new_bars = (t_bar *)getbytes(added * sizeof(t_bar));
+        if (!new_events || !new_bars) {
+            info_post("SheetMidi: Failed to allocate memory for events");
+            if (new_events) freebytes(new_events, added_events * sizeof(t_chord_event));
+            if (new_bars) freebytes(new_bars, added * sizeof(t_bar));
+            x->num_events = old_events;
+            x->num_bars = old_bars;
+            return 0;
+        }
+        memcpy(new_events, x->events + old_events, added_events * sizeof(t_chord_event));
+        memcpy(new_bars, x->bars + old_bars, added * sizeof(t_bar));
+        memmove(x->events + event_at + added_events, x->events + event_at + removed_events, 
+                (old_events - event_at - removed_events) * sizeof(t_chord_event));
+        memmove(x->bars + at + added, x->bars + at + remove, (old_bars - at - remove) * sizeof(t_bar));
+        memcpy(x->events + event_at, new_events, added_events * sizeof(t_chord_event));
+        memcpy(x->bars + at, new_bars, added * sizeof(t_bar));
+        freebytes(new_events, added_events * sizeof(t_chord_event));
+        freebytes(new_bars, added * sizeof(t_bar));
+    } else if (added > 0 || remove > 0) {
+        // Appending at the end or deleting: a single move closes the gap
+        memmove(x->events + event_at, x->events + event_at + removed_events, 
+                (x->num_events - event_at - removed_events) * sizeof(t_chord_event));
+        memmove(x->bars + at, x->bars + at + remove, (x->num_bars - at - remove) * sizeof(t_bar));
+    }
+    x->num_events -= removed_events;
+    x->num_bars -= remove;
+    
+    if (x->num_bars == 0) {
+        clear_events(x);
+        info_post("SheetMidi: Chart is empty");
+        return 1;
+    }
+    if (!rebuild_chart(x, at, at + added, event_at)) return 0;
+    
+    // Follow the bar that was playing, a removed bar continues at the first bar after the edit
+    if (pos_bar >= at + remove) {
+        if (added != remove) pos_segment = -1;
+        pos_bar += added - remove;
+    } else if (pos_bar >= at) {
+        pos_bar = at < x->num_bars ? at : 0;
+        pos_beat = 0;
+        pos_segment = -1;
+    }
+    restore_position(x, pos_bar, pos_beat, pos_segment);
+    update_loop(x);
+    
+    info_post("SheetMidi: %d bars, %d beats", x->num_bars, x->total_duration);
+    return 1;
+}
+
+// Helper function to add the loaded chart to the corpus for learn, charts that were
+// recorded before are skipped so reloading one doesn't weigh it more
+static void record_chart(t_p_sheetmidi *x) {
+    switch (markov_record(&x->markov, x->events, x->bars, x->segments, x->num_segments)) {
+        case MARKOV_DUPLICATE:
+            debug_post(x, "SheetMidi DEBUG: Chart is already in the learn corpus");
+            break;
+        case MARKOV_FULL:
+            info_post("SheetMidi: Learn corpus is full (%d chords), send 'learn clear' to record new charts",
+                      MARKOV_MAX_CORPUS);
+            break;
+        case MARKOV_FAILED:
+            info_post("SheetMidi: Failed to record the chart for learn");
+            break;
+    }
+}
+
+// Helper function to turn chart text into tokens stored as symbol atoms. Caller frees the result.
+static t_atom *tokenize_text(t_p_sheetmidi *x, const char *text, int *num_atoms) {
+    token_t *tokens = NULL;
+    int num_tokens = 0;
+    t_atom *atoms = NULL;
+    
+    *num_atoms = 0;
+    if (tokenize_string(x, text, &tokens, &num_tokens)) {
+        atoms = (t_atom *)getbytes((num_tokens > 0 ? num_tokens : 1) * sizeof(t_atom));
+        if (atoms) {
+            for (int i = 0; i < num_tokens; i++) {
+                SETSYMBOL(&atoms[i], tokens[i].value);
+            }
+            *num_atoms = num_tokens;
+        }
+        freebytes(tokens, num_tokens * sizeof(token_t));
+    }
+    return atoms;
+}
+
+// Helper function to turn incoming atoms into chart tokens stored as symbol atoms.
+// The selector is the first word unless it is NULL or "list". Caller frees the result.
+static t_atom *tokenize_atoms(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv, int *num_atoms) {
+    *num_atoms = 0;
+    
+    // Size the string for every argument, numbers take at most 16 characters
+    int buffer_size = 2 + (s ? strlen(s->s_name) : 0);
+    for (int i = 0; i < argc; i++) {
+        buffer_size += 1 + (argv[i].a_type == A_SYMBOL ? strlen(atom_getsymbol(&argv[i])->s_name) : 16);
+    }
+    char *combined = (char *)getbytes(buffer_size);
+    if (!combined) {
+        info_post("SheetMidi: Failed to allocate memory for input string");
+        return NULL;
+    }
+    
+    // Start with selector, lists starting with an ending number arrive as "list"
+    combined[0] = '\0';
+    if (s && s != &s_list) {
+        strcpy(combined, s->s_name);
+    }
+    int pos = strlen(combined);
+    
+    // Add arguments
+    for (int i = 0; i < argc; i++) {
+        combined[pos++] = ' ';  // Always add a space before each argument
+        if (argv[i].a_type == A_SYMBOL) {
+            t_symbol *sym = atom_getsymbol(&argv[i]);
+            strcpy(combined + pos, sym->s_name);
+            pos += strlen(sym->s_name);
+        } else if (argv[i].a_type == A_FLOAT) {
+            // Pd reads "1." as a float, numbers in a chart mark endings
+            pos += snprintf(combined + pos, buffer_size - pos, "%d.", (int)atom_getfloat(&argv[i]));
+        }
+    }
+    combined[pos] = '\0';
+    
+    t_atom *atoms = tokenize_text(x, combined, num_atoms);
+    freebytes(combined, buffer_size);
+    return atoms;
+}
+
+// Helper function to give every bar without its own meter the time signature
+static void rebar_chart(t_p_sheetmidi *x) {
+    if (x->num_bars == 0) return;
+    
+    int pos_bar = x->cursor.bar;
+    int pos_beat = x->events[x->cursor.event].start + x->cursor.event_beat - x->bars[pos_bar].start;
+    int pos_segment = x->cursor.segment;
+    
+    for (int i = 0; i < x->num_bars; i++) {
+        t_bar *bar = &x->bars[i];
+        if (bar->meter_unit != 0) continue;
+        bar->meter = x->time_signature;
+        if (!bar->dotted) {
+            distribute_beats_in_bar(x->events, bar->first_event, bar->num_events, bar->meter);
+        }
+    }
+    
+    // Chords are unchanged, so are their voicings
+    if (!rebuild_chart(x, 0, x->num_bars, x->num_events)) return;
+    restore_position(x, pos_bar, pos_beat, pos_segment);
+    update_loop(x);
+    output_beat_position(x);
+}
+
+// Helper function to read a written bar number for an edit command
+static int edit_bar_arg(t_p_sheetmidi *x, const char *command, int argc, t_atom *argv, int *bar) {
+    if (argc < 1 || argv[0].a_type != A_FLOAT) {
+        info_post("SheetMidi: %s needs a bar number", command);
+        return 0;
+    }
+    *bar = (int)atom_getfloat(&argv[0]) - 1;
+    if (*bar < 0 || *bar >= x->num_bars) {
+        info_post("SheetMidi: %s bar %d out of range 1-%d", command, *bar + 1, x->num_bars);
+        return 0;
+    }
+    return 1;
+}
+
+// Helper function to apply append/insert/replace: tokenize the new bars and splice them in
+static void edit_command(t_p_sheetmidi *x, int at, int remove, int argc, t_atom *argv) {
+    int num_atoms = 0;
+    t_atom *atoms = tokenize_atoms(x, NULL, argc, argv, &num_atoms);
+    if (!atoms) return;
+    if (num_atoms > 0 && edit_bars(x, at, remove, num_atoms, atoms)) {
+        print_parsed_sequence(x);
+    }
+    freebytes(atoms, (num_atoms > 0 ? num_atoms : 1) * sizeof(t_atom));
+}
+
+// Update proxy class to handle both symbol and list input
+void p_sheetmidi_proxy_anything(t_p_sheetmidi_proxy *p, t_symbol *s, int argc, t_atom *argv) {
+    if (!p || !p->x) return;
+    t_p_sheetmidi *x = p->x;
+    int bar;
+
+    // Handle time signature changes
+    if (s == gensym("time")) {
+        if (argc > 0 && argv[0].a_type == A_FLOAT) {
+            t_float new_time_sig = atom_getfloat(&argv[0]);
+            if (new_time_sig != x->time_signature) {
+                x->time_signature = new_time_sig;
+                info_post("SheetMidi: Time signature set to %d", (int)x->time_signature);
+                
+                // Re-bar the stored chart in place
+                if (x->num_bars > 0) {
+                    rebar_chart(x);
+                    print_parsed_sequence(x);
+                }
+            }
+        }
+        return;
+    }
+
+    // Handle beat reset
+    if (s == gensym("beat")) {
+        if (argc > 0 && argv[0].a_type == A_FLOAT) {
+            reset_beat(x, atom_getfloat(&argv[0]));
+        }
+        return;
+    }
+
+    // Handle bar reset
+    if (s == gensym("bar")) {
+        if (argc > 0 && argv[0].a_type == A_FLOAT) {
+            reset_bar(x, atom_getfloat(&argv[0]), atom_getfloatarg(1, argc, argv));
+        }
+        return;
+    }
+
+    // Incremental edits by written bar number, only the new bars are parsed
+    if (s == gensym("append")) {
+        edit_command(x, x->num_bars, 0, argc, argv);
+        return;
+    }
+    if (s == gensym("insert")) {
+        // Inserting before one past the last bar appends
+        if (argc > 0 && argv[0].a_type == A_FLOAT && (int)atom_getfloat(&argv[0]) == x->num_bars + 1) {
+            edit_command(x, x->num_bars, 0, argc - 1, argv + 1);
+        } else if (edit_bar_arg(x, "insert", argc, argv, &bar)) {
+            edit_command(x, bar, 0, argc - 1, argv + 1);
+        }
+        return;
+    }
+    if (s == gensym("replace")) {
+        if (edit_bar_arg(x, "replace", argc, argv, &bar)) {
+            edit_command(x, bar, -1, argc - 1, argv + 1);
         }
+        return;
     }
-    
-    // Calculate total duration
-    x->total_duration = 0;
-    for (int i = 0; i < x->num_events; i++) {
-        x->total_duration += x->events[i].duration;
+    if (s == gensym("delete")) {
+        if (edit_bar_arg(x, "delete", argc, argv, &bar)) {
+            int count = argc > 1 ? (int)atom_getfloatarg(1, argc, argv) : 1;
+            if (count < 1) count = 1;
+            if (edit_bars(x, bar, count, 0, NULL) && x->num_bars > 0) {
+                print_parsed_sequence(x);
+            }
+        }
+        return;
     }
-    
-    debug_post(x, "SheetMidi DEBUG: Parsing complete - %d events, total duration %d beats", 
-         x->num_events, x->total_duration);
-    
-    // Output initial beat position after parsing
-    output_beat_position(x);
-    
-    return 1;
+
+    // For all other messages, tokenize and parse as a complete chart
+    int num_atoms = 0;
+    t_atom *atoms = tokenize_atoms(x, s, argc, argv, &num_atoms);
+    if (!atoms) return;
+    if (parse_chord_sequence(x, num_atoms, atoms)) {
+        print_parsed_sequence(x);
+        
+        // Every loaded chart becomes training material for learn
+        record_chart(x);
+    }
+    freebytes(atoms, (num_atoms > 0 ? num_atoms : 1) * sizeof(t_atom));
 }
 
 // Print the parsed sequence for debugging
@@ -330,28 +1078,52 @@ static void print_parsed_sequence(t_p_sheetmidi *x) {
         return;
     }
     
-    info_post("SheetMidi: Parsed sequence (%d events, total duration: %d beats):", 
-         x->num_events, x->total_duration);
-    
-    int current_bar = 0;
-    int beats_in_bar = 0;
+    info_post("SheetMidi: Parsed sequence (%d events in %d bars, total duration: %d beats):", 
+         x->num_events, x->num_bars, x->total_duration);
     
-    for (int i = 0; i < x->num_events; i++) {
-        t_chord_event *ev = &x->events[i];
+    for (int b = 0; b < x->num_bars; b++) {
+        t_bar *bar = &x->bars[b];
         
-        if (beats_in_bar + ev->duration > x->time_signature) {
-            current_bar++;
-            beats_in_bar = 0;
-            info_post("  |");
+        char meter[32] = "";
+        if (b == 0 || bar->meter != x->bars[b - 1].meter || bar->meter_unit != x->bars[b - 1].meter_unit) {
+            if (bar->meter_unit) snprintf(meter, sizeof(meter), " %d/%d", bar->meter, bar->meter_unit);
+            else snprintf(meter, sizeof(meter), " %d beats", bar->meter);
+        }
+        info_post("  |%s%s%s%s", 
+             (bar->flags & BAR_REPEAT_START) ? ":" : "", meter,
+             (bar->flags & BAR_SEGNO) ? " Segno" : "",
+             (bar->flags & BAR_CODA) ? " Coda" : "");
+        if (bar->volta) {
+            info_post("  %d.", bar->volta);
         }
         
-        info_post("    Event %d (bar %d, beat %d): %s (%d beats)", 
-             i + 1, current_bar + 1, beats_in_bar + 1,
-             ev->chord->s_name, ev->duration);
-        
-        debug_print_chord("      Chord data", &ev->parsed);
+        for (int i = bar->first_event; i < bar->first_event + bar->num_events; i++) {
+            t_chord_event *ev = &x->events[i];
+            
+            info_post("    Event %d (bar %d, beat %d): %s%s (%d beats)", 
+                 i + 1, b + 1, ev->start - bar->start + 1,
+                 ev->anticipated ? ">" : "", ev->chord->s_name, ev->duration);
+            
+            debug_print_chord("      Chord data", &ev->parsed);
+        }
         
-        beats_in_bar += ev->duration;
+        if (bar->flags & ~(BAR_REPEAT_START | BAR_SEGNO | BAR_CODA)) {
+            info_post("  %s%s%s%s%s%s%s", 
+                 (bar->flags & BAR_TO_CODA) ? " To Coda" : "",
+                 (bar->flags & BAR_FINE) ? " Fine" : "",
+                 (bar->flags & BAR_DA_CAPO) ? " D.C." : "",
+                 (bar->flags & BAR_DAL_SEGNO) ? " D.S." : "",
+                 (bar->flags & BAR_AL_CODA) ? " al Coda" : "",
+                 (bar->flags & BAR_AL_FINE) ? " al Fine" : "",
+                 (bar->flags & BAR_REPEAT_END) ? " :|" : "");
+        }
+    }
+    
+    info_post("  Form:");
+    for (int i = 0; i < x->num_segments; i++) {
+        t_form_segment *seg = &x->segments[i];
+        info_post("    Bars %d-%d from beat %d (bar %d)", seg->start_bar + 1, seg->end_bar, 
+             seg->start_beat, seg->start_bar_number + 1);
     }
 }
 
@@ -363,13 +1135,13 @@ void p_sheetmidi_note(t_p_sheetmidi *x) {
     output_debug_chord(x, ev);
     
     if (ev->parsed.num_intervals <= 0) {
-        t_float note = ev->parsed.root_offset;
+        t_float note = transposed_root(x, &ev->parsed);
         outlet_float(x->note_outlet, note);
         return;
     }
     
     int random_idx = rand() % ev->parsed.num_intervals;
-    t_float note = ev->parsed.root_offset + ev->parsed.intervals[random_idx];
+    t_float note = transposed_root(x, &ev->parsed) + ev->parsed.intervals[random_idx];
     outlet_float(x->note_outlet, note);
 }
 
@@ -378,7 +1150,7 @@ void p_sheetmidi_root(t_p_sheetmidi *x) {
     if (!ev) return;
     
     output_debug_chord(x, ev);
-    t_float note = ev->parsed.root_offset + ev->parsed.intervals[0];
+    t_float note = transposed_root(x, &ev->parsed) + ev->parsed.intervals[0];
     outlet_float(x->note_outlet, note);
 }
 
@@ -387,7 +1159,7 @@ void p_sheetmidi_third(t_p_sheetmidi *x) {
     if (!ev || ev->parsed.num_intervals < 2) return;
     
     output_debug_chord(x, ev);
-    t_float note = ev->parsed.root_offset + ev->parsed.intervals[1];
+    t_float note = transposed_root(x, &ev->parsed) + ev->parsed.intervals[1];
     outlet_float(x->note_outlet, note);
 }
 
@@ -396,10 +1168,96 @@ void p_sheetmidi_fifth(t_p_sheetmidi *x) {
     if (!ev || ev->parsed.num_intervals < 3) return;
     
     output_debug_chord(x, ev);
-    t_float note = ev->parsed.root_offset + ev->parsed.intervals[2];
+    t_float note = transposed_root(x, &ev->parsed) + ev->parsed.intervals[2];
     outlet_float(x->note_outlet, note);
 }
 
+// Output the chord tones of the event k events away without moving the playback position,
+// the chord and its distance in beats go to the info outlet first
+static void output_event_at(t_p_sheetmidi *x, t_symbol *selector, int k) {
+    if (x->total_duration <= 0) return;
+    
+    int beats;
+    t_play_cursor c = step_cursor(x, k, &beats);
+    t_chord_event *ev = &x->events[c.event];
+    
+    t_atom info[2];
+    SETSYMBOL(&info[0], spelled_chord(x, ev));
+    SETFLOAT(&info[1], beats < 0 ? -beats : beats);
+    outlet_anything(x->info_outlet, selector, 2, info);
+    
+    t_atom tones[12];
+    int root = transposed_root(x, &ev->parsed);
+    for (int i = 0; i < ev->parsed.num_intervals; i++) {
+        SETFLOAT(&tones[i], root + ev->parsed.intervals[i]);
+    }
+    outlet_list(x->list_outlet, &s_list, ev->parsed.num_intervals, tones);
+}
+
+// Chord tones of the k-th next event: next [k]
+void p_sheetmidi_next(t_p_sheetmidi *x, t_float k) {
+    output_event_at(x, gensym("next"), k >= 1 ? (int)k : 1);
+}
+
+// Chord tones of the k-th previous event: prev [k]
+void p_sheetmidi_prev(t_p_sheetmidi *x, t_float k) {
+    output_event_at(x, gensym("prev"), k >= 1 ? -(int)k : -1);
+}
+
+// Beats left in the current event, including the current beat
+void p_sheetmidi_remaining(t_p_sheetmidi *x) {
+    t_chord_event *ev = get_current_event(x);
+    if (!ev) return;
+    
+    t_atom beats;
+    SETFLOAT(&beats, ev->duration - x->cursor.event_beat);
+    outlet_anything(x->info_outlet, gensym("remaining"), 1, &beats);
+}
+
+// Roman numeral of the current chord in its local key: function -> function <numeral> <degree>,
+// degree is the root in semitones above the local tonic
+void p_sheetmidi_function(t_p_sheetmidi *x) {
+    t_chord_event *ev = get_current_event(x);
+    if (!ev || !ev->function) return;
+    
+    t_atom info[2];
+    SETSYMBOL(&info[0], ev->function);
+    SETFLOAT(&info[1], ((ev->parsed.root_offset - ev->key % KEY_MINOR) % 12 + 12) % 12);
+    outlet_anything(x->info_outlet, gensym("function"), 2, info);
+}
+
+// Local key of the current chord: key -> key <tonic> major|minor <tonic pitch class>,
+// the tonic is spelled and transposed like the chord symbols
+void p_sheetmidi_key(t_p_sheetmidi *x) {
+    t_chord_event *ev = get_current_event(x);
+    if (!ev || ev->key < 0) return;
+    
+    int tonic = ev->key % KEY_MINOR;
+    int written = ((tonic + x->transpose - x->capo) % 12 + 12) % 12;
+    t_atom info[3];
+    SETSYMBOL(&info[0], gensym(x->spelling[written]));
+    SETSYMBOL(&info[1], gensym(ev->key >= KEY_MINOR ? "minor" : "major"));
+    SETFLOAT(&info[2], ((tonic + x->transpose) % 12 + 12) % 12);
+    outlet_anything(x->info_outlet, gensym("key"), 3, info);
+}
+
+// Memory held by this object: memory -> memory <total bytes> <chart bytes> <generator bytes>
+void p_sheetmidi_memory(t_p_sheetmidi *x) {
+    int chart = x->events_capacity * sizeof(t_chord_event) + 
+                x->bars_capacity * sizeof(t_bar) + 
+                x->num_segments * sizeof(t_form_segment) + 
+                x->offsets_capacity * sizeof(float);
+    int generator = markov_footprint(&x->markov);
+    int total = sizeof(t_p_sheetmidi) + chart + generator + 
+                (x->scale_notes ? 128 * sizeof(t_atom) : 0);
+    
+    t_atom info[3];
+    SETFLOAT(&info[0], total);
+    SETFLOAT(&info[1], chart);
+    SETFLOAT(&info[2], generator);
+    outlet_anything(x->info_outlet, gensym("memory"), 3, info);
+}
+
 // Comparison function for qsort
 static int compare_atoms(const void *a, const void *b) {
     t_float val_a = atom_getfloat((t_atom *)a);
@@ -446,7 +1304,7 @@ void p_sheetmidi_all(t_p_sheetmidi *x) {
     // Process each interval one at a time
     for (int i = 0; i < chord->num_intervals; i++) {
         // Calculate base note for this interval
-        t_float base_note = chord->root_offset + chord->intervals[i];
+        t_float base_note = transposed_root(x, chord) + chord->intervals[i];
         
         // Normalize to 0-11 range
         while (base_note >= 12) base_note -= 12;
@@ -472,15 +1330,399 @@ void p_sheetmidi_all(t_p_sheetmidi *x) {
     freebytes(output_list, max_notes * sizeof(t_atom));
 }
 
+// Helper function to send a note/velocity pair through the arpeggiator outlet
+static void arp_send(t_p_sheetmidi *x, int note, int velocity) {
+    t_atom pair[2];
+    SETFLOAT(&pair[0], note);
+    SETFLOAT(&pair[1], velocity);
+    outlet_list(x->arp_outlet, &s_list, 2, pair);
+}
+
+// Helper function to release the sounding arpeggiator note
+static void arp_release(t_p_sheetmidi *x) {
+    clock_unset(x->arp_off_clock);
+    if (x->arp_note >= 0) {
+        arp_send(x, x->arp_note, 0);
+        x->arp_note = -1;
+    }
+}
+
+static void arp_off_tick(t_p_sheetmidi *x) {
+    arp_release(x);
+}
+
+// Play one arpeggiator step from the cached voicing of the current chord
+static void arp_step(t_p_sheetmidi *x) {
+    t_chord_event *ev = get_current_event(x);
+    arp_release(x);
+    if (!ev || ev->voicing.count == 0) return;
+    
+    int n = ev->voicing.count;
+    int step = x->arp_index++;
+    int idx;
+    switch (x->arp_mode) {
+        case ARP_UP:
+            idx = step % n;
+            break;
+        case ARP_DOWN:
+            idx = n - 1 - step % n;
+            break;
+        case ARP_UPDOWN:
+            idx = n > 1 ? step % (2 * n - 2) : 0;
+            if (idx >= n) idx = 2 * n - 2 - idx;
+            break;
+        case ARP_RANDOM:
+            idx = rand() % n;
+            break;
+        case ARP_PATTERN:
+            if (x->arp_pattern_len == 0) return;
+            idx = x->arp_pattern[step % x->arp_pattern_len];
+            if (idx < 0) return;  // Rest
+            idx %= n;
+            break;
+        default:
+            return;
+    }
+    
+    // Same transposition as the voicing output
+    int shift = ((x->transpose % 12) + 12) % 12;
+    if (shift > 5) shift -= 12;
+    
+    x->arp_note = ev->voicing.notes[idx] + shift;
+    arp_send(x, x->arp_note, x->arp_velocity);
+    if (x->arp_gate < 1) {
+        clock_delay(x->arp_off_clock, x->arp_step_ms * x->arp_gate);
+    }
+}
+
+// Clock callback for the steps between two ticks
+static void arp_clock_tick(t_p_sheetmidi *x) {
+    if (x->arp_mode == ARP_OFF || x->arp_steps_left <= 0) return;
+    
+    x->arp_steps_left--;
+    arp_step(x);
+    if (x->arp_steps_left > 0) {
+        clock_delay(x->arp_clock, x->arp_step_ms);
+    }
+}
+
+// Start the arpeggiator steps for the beat that just began
+static void arp_beat(t_p_sheetmidi *x) {
+    if (x->arp_mode == ARP_OFF) return;
+    
+    x->arp_step_ms = x->tick_interval / x->arp_rate;
+    x->arp_steps_left = x->arp_rate;
+    clock_unset(x->arp_clock);
+    arp_clock_tick(x);
+}
+
 void p_sheetmidi_tick(t_p_sheetmidi *x) {
     if (x->num_events == 0) return;
     
-    x->current_beat++;
-    if (x->current_beat >= x->total_duration) {
-        x->current_beat = 0;
+    if (x->total_duration <= 0) return;
+    
+    // Measure the tick interval, the arpeggiator subdivides it
+    if (x->has_last_tick) {
+        double interval = clock_gettimesince(x->last_tick_time);
+        if (interval > 0) x->tick_interval = interval;
+    }
+    x->last_tick_time = clock_getlogicaltime();
+    x->has_last_tick = 1;
+    
+    advance_cursor(x);
+    
+    // A changed loop region starts at the bar line
+    if (x->loop_pending && 
+        x->events[x->cursor.event].start + x->cursor.event_beat == x->bars[x->cursor.bar].start) {
+        apply_pending_loop(x);
     }
+    
     output_debug_chord(x, get_current_event(x));
     output_beat_position(x);
+    arp_beat(x);
+}
+
+// Timing of the beat outlet: groove swing <percent>, groove feel <percent per beat...>,
+// groove anticipate <percent>, groove off. Offsets are in percent of a tick.
+void p_sheetmidi_groove(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    t_symbol *cmd = atom_getsymbolarg(0, argc, argv);
+    
+    if (cmd == gensym("off")) {
+        x->groove_swing = 50;
+        x->groove_feel_len = 0;
+    } else if (cmd == gensym("swing") && argc >= 2) {
+        t_float swing = atom_getfloatarg(1, argc, argv);
+        x->groove_swing = swing < 50 ? 50 : (swing > 90 ? 90 : swing);
+    } else if (cmd == gensym("feel")) {
+        if (argc - 1 > GROOVE_MAX_FEEL) {
+            info_post("SheetMidi: groove feel takes at most %d beats", GROOVE_MAX_FEEL);
+        }
+        x->groove_feel_len = 0;
+        for (int i = 1; i < argc && x->groove_feel_len < GROOVE_MAX_FEEL; i++) {
+            t_float offset = atom_getfloatarg(i, argc, argv);
+            x->groove_feel[x->groove_feel_len++] = offset < -50 ? -50 : (offset > 50 ? 50 : offset);
+        }
+    } else if (cmd == gensym("anticipate") && argc >= 2) {
+        t_float anticipation = atom_getfloatarg(1, argc, argv);
+        x->anticipation = anticipation < 0 ? 0 : (anticipation > 100 ? 100 : anticipation);
+    } else {
+        info_post("SheetMidi: groove expects 'swing <percent>', 'feel <percent per beat...>', "
+                  "'anticipate <percent>' or 'off'");
+        return;
+    }
+    build_offsets(x, 0, x->num_bars, 0);
+}
+
+// Loop a region of the performed form: loop <startbar> <endbar> | loop off
+// The new region takes effect at the next bar line
+void p_sheetmidi_loop(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    if (argc >= 1 && atom_getsymbolarg(0, argc, argv) == gensym("off")) {
+        x->loop_next_start_bar = 0;
+        x->loop_next_end_bar = 0;
+    } else if (argc >= 2 && argv[0].a_type == A_FLOAT && argv[1].a_type == A_FLOAT) {
+        int start = (int)atom_getfloat(&argv[0]);
+        int end = (int)atom_getfloat(&argv[1]);
+        if (start < 1 || end < start) {
+            info_post("SheetMidi: loop needs 1 <= startbar <= endbar");
+            return;
+        }
+        x->loop_next_start_bar = start;
+        x->loop_next_end_bar = end;
+    } else {
+        info_post("SheetMidi: loop expects '<startbar> <endbar>' or 'off'");
+        return;
+    }
+    x->loop_pending = 1;
+}
+
+// Build chord transition tables from every chart loaded so far: learn | learn clear
+void p_sheetmidi_learn(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    if (argc >= 1 && atom_getsymbolarg(0, argc, argv) == gensym("clear")) {
+        markov_clear(&x->markov);
+        info_post("SheetMidi: Learned progressions cleared");
+        return;
+    }
+    
+    int transitions = markov_learn(&x->markov);
+    if (!x->markov.learned) {
+        info_post("SheetMidi: Nothing to learn, load a chart first");
+        return;
+    }
+    info_post("SheetMidi: Learned %d transitions from %d progressions (%d chord qualities)",
+              transitions, x->markov.num_progressions, x->markov.num_qualities);
+}
+
+// Generate a progression from the learned tables into the event store: generate <bars> [seed]
+// The playback position is kept, so a new progression can be generated while playing
+void p_sheetmidi_generate(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    int bars = (int)atom_getfloatarg(0, argc, argv);
+    if (bars < 1) {
+        info_post("SheetMidi: generate needs a number of bars");
+        return;
+    }
+    if (!x->markov.learned) {
+        info_post("SheetMidi: Nothing learned yet, send learn first");
+        return;
+    }
+    if (argc >= 2 && argv[1].a_type == A_FLOAT) {
+        x->generate_seed = (unsigned int)atom_getfloat(&argv[1]);
+    }
+    
+    t_atom *atoms;
+    int num_atoms;
+    if (!markov_generate(&x->markov, bars, &x->generate_seed, &atoms, &num_atoms)) {
+        info_post("SheetMidi: Failed to generate a progression");
+        return;
+    }
+    if (parse_chord_sequence(x, num_atoms, atoms)) {
+        print_parsed_sequence(x);
+    }
+    freebytes(atoms, num_atoms * sizeof(t_atom));
+}
+
+// Import a chart from an iReal Pro playlist or a MusicXML file: import <file> [song]
+void p_sheetmidi_import(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    t_symbol *file = atom_getsymbolarg(0, argc, argv);
+    int song = argc > 1 ? (int)atom_getfloatarg(1, argc, argv) : 1;
+    if (!*file->s_name) {
+        info_post("SheetMidi: import needs a file name");
+        return;
+    }
+    
+    // Look the file up like Pd does, next to the patch and in the search path
+    char dir[MAXPDSTRING], *name;
+    int fd = canvas_open(x->canvas, file->s_name, "", dir, &name, MAXPDSTRING, 1);
+    if (fd < 0) {
+        info_post("SheetMidi: Can't find %s", file->s_name);
+        return;
+    }
+    FILE *fp = fdopen(fd, "rb");
+    if (!fp) {
+        info_post("SheetMidi: Can't open %s", file->s_name);
+        sys_close(fd);
+        return;
+    }
+    
+    t_import_result result;
+    int status = import_chart(fp, name, song, &result);
+    fclose(fp);
+    switch (status) {
+        case IMPORT_NO_SONG:
+            info_post("SheetMidi: %s has %d songs, can't import song %d", file->s_name, result.num_songs, song);
+            return;
+        case IMPORT_NO_CHORDS:
+            info_post("SheetMidi: No chords in song %d of %s", song, file->s_name);
+            return;
+        case IMPORT_FAILED:
+            info_post("SheetMidi: Failed to import %s", file->s_name);
+            return;
+    }
+    debug_post(x, "SheetMidi DEBUG: Imported chart: %s", result.chart);
+    
+    int num_atoms = 0;
+    t_atom *atoms = tokenize_text(x, result.chart, &num_atoms);
+    freebytes(result.chart, result.chart_size);
+    if (!atoms) return;
+    if (parse_chord_sequence(x, num_atoms, atoms)) {
+        print_parsed_sequence(x);
+        record_chart(x);
+        
+        // Reply with the song count and the title
+        t_atom reply[3];
+        SETFLOAT(&reply[0], song);
+        SETFLOAT(&reply[1], result.num_songs);
+        SETSYMBOL(&reply[2], result.title);
+        outlet_anything(x->info_outlet, gensym("import"), 3, reply);
+    }
+    freebytes(atoms, (num_atoms > 0 ? num_atoms : 1) * sizeof(t_atom));
+}
+
+// Find a named array for totable, complaining when it doesn't exist
+static t_garray *find_table(const char *name, const char *suffix) {
+    char buf[MAXPDSTRING];
+    snprintf(buf, sizeof(buf), "%s-%s", name, suffix);
+    t_garray *array = (t_garray *)pd_findbyclass(gensym(buf), garray_class);
+    if (!array) info_post("SheetMidi: totable: no array named %s", buf);
+    return array;
+}
+
+// Write the performed form into the arrays <name>-root, <name>-third, <name>-fifth and
+// <name>-index, resolution points per beat: totable <name> [resolution]
+void p_sheetmidi_totable(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    t_symbol *name = atom_getsymbolarg(0, argc, argv);
+    int resolution = argc > 1 ? (int)atom_getfloatarg(1, argc, argv) : 1;
+    if (!*name->s_name) {
+        info_post("SheetMidi: totable needs an array name");
+        return;
+    }
+    if (resolution < 1) {
+        info_post("SheetMidi: totable resolution must be at least 1 point per beat");
+        return;
+    }
+    if (x->num_events == 0 || x->total_duration <= 0) {
+        info_post("SheetMidi: No chord sequence stored");
+        return;
+    }
+    
+    // Root, third and fifth as MIDI notes like the root/third/fifth methods, -1 where the
+    // chord has no such tone, and the index of the written chord
+    static const char *suffixes[4] = {"root", "third", "fifth", "index"};
+    t_garray *arrays[4];
+    t_word *vecs[4];
+    int points = x->total_duration * resolution;
+    int found = 0;
+    for (int i = 0; i < 4; i++) {
+        arrays[i] = find_table(name->s_name, suffixes[i]);
+        vecs[i] = NULL;
+        if (!arrays[i]) continue;
+        
+        int size;
+        garray_resize_long(arrays[i], points);
+        if (!garray_getfloatwords(arrays[i], &size, &vecs[i]) || size != points) {
+            info_post("SheetMidi: totable: can't write %s-%s", name->s_name, suffixes[i]);
+            vecs[i] = NULL;
+            continue;
+        }
+        found++;
+    }
+    if (!found) return;
+    
+    // One pass over the performed form
+    int point = 0;
+    for (int seg = 0; seg < x->num_segments; seg++) {
+        t_form_segment *segment = &x->segments[seg];
+        int first = x->bars[segment->start_bar].first_event;
+        t_bar *last_bar = &x->bars[segment->end_bar - 1];
+        int end = last_bar->first_event + last_bar->num_events;
+        for (int e = first; e < end; e++) {
+            t_chord_event *ev = &x->events[e];
+            t_chord_data *chord = &ev->parsed;
+            int root = transposed_root(x, chord);
+            t_float values[4];
+            for (int i = 0; i < 3; i++) {
+                values[i] = i < chord->num_intervals ? root + chord->intervals[i] : -1;
+            }
+            values[3] = e;
+            
+            int count = ev->duration * resolution;
+            for (int i = 0; i < 4; i++) {
+                if (!vecs[i]) continue;
+                for (int j = 0; j < count; j++) vecs[i][point + j].w_float = values[i];
+            }
+            point += count;
+        }
+    }
+    
+    for (int i = 0; i < 4; i++) {
+        if (vecs[i]) garray_redraw(arrays[i]);
+    }
+    
+    // Reply with the table length and the resolution for the reading side
+    t_atom reply[2];
+    SETFLOAT(&reply[0], points);
+    SETFLOAT(&reply[1], resolution);
+    outlet_anything(x->info_outlet, gensym("totable"), 2, reply);
+}
+
+// Arpeggiator settings: arp up|down|updown|random|off, arp pattern <indices...>,
+// arp rate <steps per beat>, arp gate <0-1>, arp velocity <1-127>
+void p_sheetmidi_arp(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    t_symbol *cmd = atom_getsymbolarg(0, argc, argv);
+    
+    if (cmd == gensym("off")) {
+        x->arp_mode = ARP_OFF;
+        clock_unset(x->arp_clock);
+        arp_release(x);
+    } else if (cmd == gensym("up")) {
+        x->arp_mode = ARP_UP;
+    } else if (cmd == gensym("down")) {
+        x->arp_mode = ARP_DOWN;
+    } else if (cmd == gensym("updown")) {
+        x->arp_mode = ARP_UPDOWN;
+    } else if (cmd == gensym("random")) {
+        x->arp_mode = ARP_RANDOM;
+    } else if (cmd == gensym("pattern")) {
+        x->arp_pattern_len = 0;
+        for (int i = 1; i < argc && x->arp_pattern_len < ARP_MAX_PATTERN; i++) {
+            x->arp_pattern[x->arp_pattern_len++] = (int)atom_getfloatarg(i, argc, argv);
+        }
+        x->arp_mode = ARP_PATTERN;
+    } else if (cmd == gensym("rate") && argc > 1) {
+        int rate = (int)atom_getfloatarg(1, argc, argv);
+        x->arp_rate = rate < 1 ? 1 : rate;
+    } else if (cmd == gensym("gate") && argc > 1) {
+        t_float gate = atom_getfloatarg(1, argc, argv);
+        x->arp_gate = gate < 0.01 ? 0.01 : (gate > 1 ? 1 : gate);
+    } else if (cmd == gensym("velocity") && argc > 1) {
+        int velocity = (int)atom_getfloatarg(1, argc, argv);
+        x->arp_velocity = velocity < 1 ? 1 : (velocity > 127 ? 127 : velocity);
+    } else {
+        info_post("SheetMidi: arp expects up, down, updown, random, off, "
+             "pattern <indices>, rate <n>, gate <0-1> or velocity <n>");
+        return;
+    }
+    debug_post(x, "SheetMidi DEBUG: arp %s (rate %d, gate %.2f, velocity %d)", 
+         cmd->s_name, x->arp_rate, x->arp_gate, x->arp_velocity);
 }
 
 // Add beat handler for left inlet
@@ -489,6 +1731,128 @@ void p_sheetmidi_beat(t_p_sheetmidi *x, t_float f) {
     output_beat_position(x);
 }
 
+// Add bar handler for left inlet
+void p_sheetmidi_bar(t_p_sheetmidi *x, t_float bar, t_float beat) {
+    reset_bar(x, bar, beat);
+    output_beat_position(x);
+}
+
+// Output the precomputed voicing of the current chord, or set up the voicings:
+// voicing range <low> <high> | voicing voices <3-6>
+void p_sheetmidi_voicing(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    if (argc > 0) {
+        t_symbol *setting = atom_getsymbolarg(0, argc, argv);
+        if (setting == gensym("range") && argc >= 3) {
+            int low = (int)atom_getfloatarg(1, argc, argv);
+            int high = (int)atom_getfloatarg(2, argc, argv);
+            x->voicing_low = low < high ? low : high;
+            x->voicing_high = low < high ? high : low;
+        } else if (setting == gensym("voices") && argc >= 2) {
+            int voices = (int)atom_getfloatarg(1, argc, argv);
+            x->voicing_voices = voices < MIN_VOICES ? MIN_VOICES : (voices > MAX_VOICES ? MAX_VOICES : voices);
+        } else {
+            info_post("SheetMidi: voicing expects 'range <low> <high>' or 'voices <%d-%d>'", 
+                 MIN_VOICES, MAX_VOICES);
+            return;
+        }
+        compute_voicings(x->events, x->num_events, 0, x->voicing_low, x->voicing_high, x->voicing_voices);
+        debug_post(x, "SheetMidi DEBUG: Voicings recomputed for %d voices in %d-%d", 
+             x->voicing_voices, x->voicing_low, x->voicing_high);
+        return;
+    }
+    
+    t_chord_event *ev = get_current_event(x);
+    if (!ev) return;
+    
+    // Fold the transposition into -6..5 semitones so voicings stay near their range
+    int shift = ((x->transpose % 12) + 12) % 12;
+    if (shift > 5) shift -= 12;
+    
+    t_atom notes[MAX_VOICES];
+    for (int i = 0; i < ev->voicing.count; i++) {
+        SETFLOAT(&notes[i], ev->voicing.notes[i] + shift);
+    }
+    output_debug_chord(x, ev);
+    outlet_list(x->list_outlet, &s_list, ev->voicing.count, notes);
+}
+
+// Helper function to get the chord scale of an event as a transposed 12-bit mask
+static int transposed_scale_mask(t_p_sheetmidi *x, t_chord_event *ev) {
+    int t = ((x->transpose % 12) + 12) % 12;
+    return ((ev->scale_mask << t) | (ev->scale_mask >> (12 - t))) & 0xFFF;
+}
+
+// Output the chord scale of the current chord over the MIDI range through the list
+// outlet, its name goes to the info outlet first
+void p_sheetmidi_scale(t_p_sheetmidi *x) {
+    t_chord_event *ev = get_current_event(x);
+    if (!ev) return;
+    
+    if (!x->scale_notes) {
+        x->scale_notes = (t_atom *)getbytes(128 * sizeof(t_atom));
+        if (!x->scale_notes) return;
+    }
+    
+    // Expand the mask only when it differs from the last one
+    int mask = transposed_scale_mask(x, ev);
+    if (mask != x->scale_notes_mask) {
+        x->scale_notes_count = 0;
+        for (int note = 0; note < 128; note++) {
+            if (mask & (1 << (note % 12))) {
+                SETFLOAT(&x->scale_notes[x->scale_notes_count], note);
+                x->scale_notes_count++;
+            }
+        }
+        x->scale_notes_mask = mask;
+    }
+    
+    t_atom name;
+    SETSYMBOL(&name, gensym(chord_scale_name(ev->scale)));
+    outlet_anything(x->info_outlet, gensym("scale"), 1, &name);
+    outlet_list(x->list_outlet, &s_list, x->scale_notes_count, x->scale_notes);
+}
+
+// Test whether a note belongs to the chord scale of the current chord,
+// outputs "inscale <note> <0|1>" on the info outlet
+void p_sheetmidi_inscale(t_p_sheetmidi *x, t_float f) {
+    t_chord_event *ev = get_current_event(x);
+    if (!ev) return;
+    
+    int pc = (((int)f % 12) + 12) % 12;
+    t_atom reply[2];
+    SETFLOAT(&reply[0], f);
+    SETFLOAT(&reply[1], (transposed_scale_mask(x, ev) >> pc) & 1);
+    outlet_anything(x->info_outlet, gensym("inscale"), 2, reply);
+}
+
+// Transpose all outputs: transpose <semitones> [key]
+// The optional key (e.g. Eb, F#, Gm) selects the spelling of the chord names
+void p_sheetmidi_transpose(t_p_sheetmidi *x, t_symbol *s, int argc, t_atom *argv) {
+    if (argc < 1 || argv[0].a_type != A_FLOAT) {
+        info_post("SheetMidi: transpose needs a number of semitones");
+        return;
+    }
+    
+    t_symbol *key = atom_getsymbolarg(1, argc, argv);
+    if (!build_spelling(key, x->spelling)) {
+        info_post("SheetMidi: Unknown key %s, using default spelling", key->s_name);
+        build_spelling(NULL, x->spelling);
+        key = &s_;
+    }
+    x->transpose = (int)atom_getfloat(&argv[0]);
+    x->spelling_key = (key->s_name[0] != '\0');
+    x->spelling_version++;
+    debug_post(x, "SheetMidi DEBUG: Transpose %d semitones%s%s", x->transpose, 
+         x->spelling_key ? ", spelled in " : "", key->s_name);
+}
+
+// Capo: chord names are shown as the shapes played below the capo
+void p_sheetmidi_capo(t_p_sheetmidi *x, t_float f) {
+    x->capo = (int)f;
+    x->spelling_version++;
+    debug_post(x, "SheetMidi DEBUG: Capo at fret %d", x->capo);
+}
+
 void *p_sheetmidi_new(t_symbol *s, int argc, t_atom *argv) {
     t_p_sheetmidi *x = (t_p_sheetmidi *)pd_new(p_sheetmidi_class);
     
@@ -499,9 +1863,58 @@ void *p_sheetmidi_new(t_symbol *s, int argc, t_atom *argv) {
     x->time_signature = 4;
     x->events = NULL;
     x->num_events = 0;
+    x->events_capacity = 0;
+    x->bars = NULL;
+    x->num_bars = 0;
+    x->bars_capacity = 0;
+    x->tick_unit = 0;
+    x->segments = NULL;
+    x->num_segments = 0;
     x->total_duration = 0;
+    x->total_bars = 0;
     x->debug_enabled = 0;  // Default to debug disabled
+    x->transpose = 0;
+    x->capo = 0;
+    build_spelling(NULL, x->spelling);
+    x->spelling_key = 0;
+    x->spelling_version = 1;
+    x->voicing_low = 48;
+    x->voicing_high = 72;
+    x->voicing_voices = 4;
+    x->scale_notes = NULL;
+    x->scale_notes_count = 0;
+    x->scale_notes_mask = -1;
+    x->arp_mode = ARP_OFF;
+    x->arp_pattern_len = 0;
+    x->arp_rate = 2;
+    x->arp_gate = 0.5;
+    x->arp_velocity = 100;
+    x->arp_index = 0;
+    x->arp_steps_left = 0;
+    x->arp_step_ms = 0;
+    x->arp_note = -1;
+    x->arp_clock = clock_new(x, (t_method)arp_clock_tick);
+    x->arp_off_clock = clock_new(x, (t_method)arp_off_tick);
+    x->last_tick_time = 0;
+    x->has_last_tick = 0;
+    x->tick_interval = 500;  // Until two ticks have been measured
+    
+    // Initialize groove, straight time with anticipations half a tick early
+    x->groove_swing = 50;
+    x->groove_feel_len = 0;
+    x->anticipation = 50;
+    x->beat_offsets = NULL;
+    x->offsets_capacity = 0;
     x->current_beat = 0;
+    memset(&x->cursor, 0, sizeof(x->cursor));
+    x->loop_start_bar = 0;
+    x->loop_end_bar = 0;
+    x->loop_start_beat = 0;
+    x->loop_end_beat = 0;
+    x->loop_pending = 0;
+    markov_init(&x->markov);
+    x->generate_seed = rand();
+    x->canvas = canvas_getcurrent();
     
     // Parse creation arguments
     for (int i = 0; i < argc; i++) {
@@ -516,18 +1929,22 @@ void *p_sheetmidi_new(t_symbol *s, int argc, t_atom *argv) {
     
     x->note_outlet = outlet_new(&x->x_obj, &s_float);
     x->list_outlet = outlet_new(&x->x_obj, &s_list);  // Add new list outlet
-    x->beat_outlet = outlet_new(&x->x_obj, &s_float);  // Add new beat position outlet
+    x->beat_outlet = outlet_new(&x->x_obj, &s_list);  // Beat position as "beat bar beat-in-bar"
     x->debug_outlet = outlet_new(&x->x_obj, &s_symbol);
+    x->info_outlet = outlet_new(&x->x_obj, 0);  // Query replies with a selector
+    x->arp_outlet = outlet_new(&x->x_obj, &s_list);  // Arpeggiator note/velocity pairs
     
     return (void *)x;
 }
 
 void p_sheetmidi_free(t_p_sheetmidi *x) {
-    clear_events(x);
-    if (last_sequence) {
-        freebytes(last_sequence, last_sequence_size * sizeof(t_atom));
-        last_sequence = NULL;
-        last_sequence_size = 0;
+    clock_free(x->arp_clock);
+    clock_free(x->arp_off_clock);
+    free_store(x);
+    markov_free(&x->markov);
+    if (x->scale_notes) {
+        freebytes(x->scale_notes, 128 * sizeof(t_atom));
+        x->scale_notes = NULL;
     }
 }
 
@@ -570,6 +1987,123 @@ EXTERN void p_sheetmidi_setup(void) {
                    A_FLOAT,
                    0);
     
+    // Add bar method to seek by bar and beat
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_bar,
+                   gensym("bar"),
+                   A_FLOAT,
+                   A_DEFFLOAT,
+                   0);
+    
+    // Add look-ahead methods
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_next,
+                   gensym("next"),
+                   A_DEFFLOAT,
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_prev,
+                   gensym("prev"),
+                   A_DEFFLOAT,
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_remaining,
+                   gensym("remaining"),
+                   0);
+    
+    // Add function and key methods
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_function,
+                   gensym("function"),
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_key,
+                   gensym("key"),
+                   0);
+    
+    // Add voicing method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_voicing,
+                   gensym("voicing"),
+                   A_GIMME,
+                   0);
+    
+    // Add arpeggiator method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_arp,
+                   gensym("arp"),
+                   A_GIMME,
+                   0);
+    
+    // Add chord scale methods
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_scale,
+                   gensym("scale"),
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_inscale,
+                   gensym("inscale"),
+                   A_FLOAT,
+                   0);
+    
+    // Add transposition methods
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_transpose,
+                   gensym("transpose"),
+                   A_GIMME,
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_capo,
+                   gensym("capo"),
+                   A_FLOAT,
+                   0);
+    
+    // Add loop method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_loop,
+                   gensym("loop"),
+                   A_GIMME,
+                   0);
+    
+    // Add learn and generate methods
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_learn,
+                   gensym("learn"),
+                   A_GIMME,
+                   0);
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_generate,
+                   gensym("generate"),
+                   A_GIMME,
+                   0);
+    
+    // Add import method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_import,
+                   gensym("import"),
+                   A_GIMME,
+                   0);
+    
+    // Add groove method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_groove,
+                   gensym("groove"),
+                   A_GIMME,
+                   0);
+    
+    // Add memory method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_memory,
+                   gensym("memory"),
+                   0);
+    
+    // Add totable method
+    class_addmethod(p_sheetmidi_class,
+                   (t_method)p_sheetmidi_totable,
+                   gensym("totable"),
+                   A_GIMME,
+                   0);
+    
     // Add "all" method
     class_addmethod(p_sheetmidi_class,
                    (t_method)p_sheetmidi_all,
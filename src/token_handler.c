@@ -5,17 +5,13 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stdlib.h>
+#include <stdio.h>
 
-token_t atom_to_token(t_atom *atom) {
-    token_t token = {TOKEN_ERROR, NULL};
-    
-    if (atom->a_type != A_SYMBOL) {
-        info_post("SheetMidi: Got non-symbol atom");
-        return token;
-    }
-    
-    t_symbol *sym = atom_getsymbol(atom);
+token_t symbol_to_token(t_symbol *sym) {
+    token_t token = {TOKEN_CHORD, sym, 0, 0};
     const char *str = sym->s_name;
+    int len = strlen(str);
     
     if (strcmp(str, ".") == 0) {
         token.type = TOKEN_DOT;
@@ -23,14 +19,67 @@ token_t atom_to_token(t_atom *atom) {
     else if (strcmp(str, "|") == 0) {
         token.type = TOKEN_BAR;
     }
-    else {
-        token.type = TOKEN_CHORD;
-        token.value = sym;
+    else if (strcmp(str, "|:") == 0) {
+        token.type = TOKEN_REPEAT_START;
+    }
+    else if (strcmp(str, ":|") == 0) {
+        token.type = TOKEN_REPEAT_END;
+    }
+    else if (len >= 2 && len <= 3 && str[len - 1] == '.' && isdigit((unsigned char)str[0]) &&
+             (len == 2 || isdigit((unsigned char)str[1]))) {
+        token.type = TOKEN_VOLTA;
+        token.number = atoi(str);
+    }
+    else if (isdigit((unsigned char)str[0]) && strchr(str, '/')) {
+        int beats = 0, unit = 0;
+        char rest = 0;
+        if (sscanf(str, "%d/%d%c", &beats, &unit, &rest) == 2 && beats > 0 && unit > 0) {
+            token.type = TOKEN_METER;
+            token.number = beats;
+            token.unit = unit;
+        } else {
+            token.type = TOKEN_ERROR;
+        }
+    }
+    else if (strcmp(str, "Segno") == 0) {
+        token.type = TOKEN_SEGNO;
+    }
+    else if (strcmp(str, "Coda") == 0) {
+        token.type = TOKEN_CODA;
+    }
+    else if (strcmp(str, "To") == 0) {
+        token.type = TOKEN_TO;
+    }
+    else if (strcmp(str, "Fine") == 0) {
+        token.type = TOKEN_FINE;
+    }
+    else if (strcmp(str, "D.C.") == 0 || strcmp(str, "DC") == 0) {
+        token.type = TOKEN_DA_CAPO;
+    }
+    else if (strcmp(str, "D.S.") == 0 || strcmp(str, "DS") == 0) {
+        token.type = TOKEN_DAL_SEGNO;
+    }
+    else if (strcmp(str, "al") == 0) {
+        token.type = TOKEN_AL;
+    }
+    else if (str[0] == '>' && str[1]) {
+        token.number = 1;  // Anticipated chord
     }
     
     return token;
 }
 
+token_t atom_to_token(t_atom *atom) {
+    token_t token = {TOKEN_ERROR, NULL, 0, 0};
+    
+    if (atom->a_type != A_SYMBOL) {
+        info_post("SheetMidi: Got non-symbol atom");
+        return token;
+    }
+    
+    return symbol_to_token(atom_getsymbol(atom));
+}
+
 int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *num_tokens) {
     if (!x || !str || !tokens || !num_tokens) return 0;
     
@@ -84,6 +133,10 @@ int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *nu
             continue;
         }
         if (*p == '|') {
+            // A pending ":" turns the bar marker into a repeat end
+            int repeat_end = (token_len == 1 && token_buf[0] == ':');
+            if (repeat_end) token_len = 0;
+            
             // Output any pending token
             if (token_len > 0) {
                 token_buf[token_len] = '\0';
@@ -92,16 +145,21 @@ int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *nu
                     token_buf[--token_len] = '\0';
                 }
                 if (token_len > 0) {
-                    (*tokens)[*num_tokens].type = TOKEN_CHORD;
-                    (*tokens)[*num_tokens].value = gensym(token_buf);
+                    (*tokens)[*num_tokens] = symbol_to_token(gensym(token_buf));
                     (*num_tokens)++;
                 }
                 token_len = 0;
             }
             
-            // Output the bar marker
-            (*tokens)[*num_tokens].type = TOKEN_BAR;
-            (*tokens)[*num_tokens].value = NULL;
+            // Output the bar marker, "|:" opens a repeat
+            if (repeat_end) {
+                (*tokens)[*num_tokens] = symbol_to_token(gensym(":|"));
+            } else if (p[1] == ':') {
+                (*tokens)[*num_tokens] = symbol_to_token(gensym("|:"));
+                p++;
+            } else {
+                (*tokens)[*num_tokens] = symbol_to_token(gensym("|"));
+            }
             (*num_tokens)++;
         } else if (isspace((unsigned char)*p)) {
             if (token_len > 0) {
@@ -111,8 +169,7 @@ int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *nu
                     token_buf[--token_len] = '\0';
                 }
                 if (token_len > 0) {
-                    (*tokens)[*num_tokens].type = TOKEN_CHORD;
-                    (*tokens)[*num_tokens].value = gensym(token_buf);
+                    (*tokens)[*num_tokens] = symbol_to_token(gensym(token_buf));
                     (*num_tokens)++;
                 }
                 token_len = 0;
@@ -133,11 +190,17 @@ int tokenize_string(t_p_sheetmidi *x, const char *str, token_t **tokens, int *nu
             token_buf[--token_len] = '\0';
         }
         if (token_len > 0) {
-            (*tokens)[*num_tokens].type = TOKEN_CHORD;
-            (*tokens)[*num_tokens].value = gensym(token_buf);
+            (*tokens)[*num_tokens] = symbol_to_token(gensym(token_buf));
             (*num_tokens)++;
         }
     }
     
+    // Trim the array to the tokens found, callers free num_tokens tokens
+    if (*num_tokens < max_tokens) {
+        token_t *trimmed = (token_t *)resizebytes(*tokens, max_tokens * sizeof(token_t),
+                                                  *num_tokens * sizeof(token_t));
+        if (trimmed) *tokens = trimmed;
+    }
+    
     return 1;
 } 
\ No newline at end of file
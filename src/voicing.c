@@ -0,0 +1,203 @@
+#include "m_pd.h"
+#include "voicing.h"
+#include <string.h>
+#include <stdlib.h>
+
+#define MAX_CANDIDATES 48
+
+// Pick the pitch classes to voice, most important first: third, seventh (or sixth),
+// root, extensions, fifth. Short chords double root, fifth and third.
+static int choose_tones(const t_chord_data *chord, int voices, int *pcs) {
+    int distinct[12];
+    int num_distinct = 0;
+
+    if (chord->num_intervals <= 0) return 0;
+
+    int order[12];
+    int num_order = 0;
+    if (chord->num_intervals > 1) order[num_order++] = 1;
+    if (chord->num_intervals > 3) order[num_order++] = 3;
+    order[num_order++] = 0;
+    for (int i = 4; i < chord->num_intervals; i++) order[num_order++] = i;
+    if (chord->num_intervals > 2) order[num_order++] = 2;
+
+    for (int i = 0; i < num_order; i++) {
+        int pc = (chord->root_offset + chord->intervals[order[i]]) % 12;
+        int seen = 0;
+        for (int j = 0; j < num_distinct; j++) {
+            if (distinct[j] == pc) seen = 1;
+        }
+        if (!seen) distinct[num_distinct++] = pc;
+    }
+
+    int count = num_distinct < voices ? num_distinct : voices;
+    for (int i = 0; i < count; i++) {
+        pcs[i] = distinct[i];
+    }
+
+    // Doubling order: root, fifth, third
+    int doubling[3];
+    int num_doubling = 0;
+    doubling[num_doubling++] = chord->root_offset % 12;
+    if (chord->num_intervals > 2) doubling[num_doubling++] = (chord->root_offset + chord->intervals[2]) % 12;
+    if (chord->num_intervals > 1) doubling[num_doubling++] = (chord->root_offset + chord->intervals[1]) % 12;
+    for (int i = 0; count < voices; i++) {
+        pcs[count++] = doubling[i % num_doubling];
+    }
+    return count;
+}
+
+static int compare_ints(const void *a, const void *b) {
+    return *(const int *)a - *(const int *)b;
+}
+
+static void add_candidate(t_voicing *cands, int *num_cands, const int *notes, int count) {
+    if (*num_cands >= MAX_CANDIDATES) return;
+
+    int sorted[MAX_VOICES];
+    memcpy(sorted, notes, count * sizeof(int));
+    qsort(sorted, count, sizeof(int), compare_ints);
+
+    t_voicing *v = &cands[(*num_cands)++];
+    for (int i = 0; i < count; i++) {
+        v->notes[i] = sorted[i];
+    }
+    v->count = count;
+}
+
+// Close position voicings of every inversion at every octave inside the range,
+// plus their drop 2 variants
+static int build_candidates(const t_chord_data *chord, int low, int high, int voices, t_voicing *cands) {
+    int pcs[MAX_VOICES];
+    int count = choose_tones(chord, voices, pcs);
+    int num_cands = 0;
+    if (count == 0) {
+        cands[0].count = 0;
+        return 1;
+    }
+    qsort(pcs, count, sizeof(int), compare_ints);
+
+    for (int rot = 0; rot < count; rot++) {
+        int bottom = low + ((pcs[rot] - low) % 12 + 12) % 12;
+        for (; bottom <= high; bottom += 12) {
+            int notes[MAX_VOICES];
+            notes[0] = bottom;
+            for (int i = 1; i < count; i++) {
+                int pc = pcs[(rot + i) % count];
+                int step = ((pc - notes[i - 1]) % 12 + 12) % 12;
+                notes[i] = notes[i - 1] + (step ? step : 12);
+            }
+            if (notes[count - 1] > high) break;
+            add_candidate(cands, &num_cands, notes, count);
+
+            if (count >= 4 && notes[count - 2] - 12 >= low) {
+                notes[count - 2] -= 12;
+                add_candidate(cands, &num_cands, notes, count);
+            }
+        }
+    }
+
+    // Range too narrow for a close voicing: fold every tone into the lowest octave
+    if (num_cands == 0) {
+        int notes[MAX_VOICES];
+        for (int i = 0; i < count; i++) {
+            notes[i] = low + ((pcs[i] - low) % 12 + 12) % 12;
+            if (notes[i] > 127) notes[i] -= 12;
+        }
+        add_candidate(cands, &num_cands, notes, count);
+    }
+    return num_cands;
+}
+
+// Voice movement between two voicings, compared voice by voice from the bottom
+static int movement(const t_voicing *a, const t_voicing *b) {
+    int count = a->count < b->count ? a->count : b->count;
+    int cost = 0;
+    for (int i = 0; i < count; i++) {
+        cost += abs((int)a->notes[i] - (int)b->notes[i]);
+    }
+    return cost;
+}
+
+// Distance of a voicing from the middle of the range, keeps the line from drifting
+static int placement(const t_voicing *v, int centre) {
+    if (v->count == 0) return 0;
+    int sum = 0;
+    for (int i = 0; i < v->count; i++) {
+        sum += v->notes[i];
+    }
+    return abs(sum - centre * v->count) / v->count;
+}
+
+void compute_voicings(t_chord_event *events, int num_events, int first,
+                      int low, int high, int voices) {
+    if (first < 0) first = 0;
+    if (!events || num_events <= first) return;
+
+    // Continue from the voicing before the first recomputed event
+    const t_voicing *anchor = first > 0 ? &events[first - 1].voicing : NULL;
+    events += first;
+    num_events -= first;
+
+    if (voices < MIN_VOICES) voices = MIN_VOICES;
+    if (voices > MAX_VOICES) voices = MAX_VOICES;
+    if (low < 0) low = 0;
+    if (high > 127) high = 127;
+    if (high < low) high = low;
+    int centre = (low + high) / 2;
+
+    t_voicing *cands = (t_voicing *)getbytes(num_events * MAX_CANDIDATES * sizeof(t_voicing));
+    int *num_cands = (int *)getbytes(num_events * sizeof(int));
+    int *cost = (int *)getbytes(num_events * MAX_CANDIDATES * sizeof(int));
+    unsigned char *back = (unsigned char *)getbytes(num_events * MAX_CANDIDATES);
+    if (!cands || !num_cands || !cost || !back) {
+        if (cands) freebytes(cands, num_events * MAX_CANDIDATES * sizeof(t_voicing));
+        if (num_cands) freebytes(num_cands, num_events * sizeof(int));
+        if (cost) freebytes(cost, num_events * MAX_CANDIDATES * sizeof(int));
+        if (back) freebytes(back, num_events * MAX_CANDIDATES);
+        return;
+    }
+
+    // Forward pass: cheapest way to reach every candidate of every event
+    for (int e = 0; e < num_events; e++) {
+        t_voicing *cur = &cands[e * MAX_CANDIDATES];
+        num_cands[e] = build_candidates(&events[e].parsed, low, high, voices, cur);
+
+        for (int c = 0; c < num_cands[e]; c++) {
+            int best = 0;
+            int best_cost = 0;
+            if (e == 0 && anchor) {
+                best_cost = movement(anchor, &cur[c]);
+            } else if (e > 0) {
+                t_voicing *prev = &cands[(e - 1) * MAX_CANDIDATES];
+                int *prev_cost = &cost[(e - 1) * MAX_CANDIDATES];
+                best_cost = -1;
+                for (int p = 0; p < num_cands[e - 1]; p++) {
+                    int total = prev_cost[p] + movement(&prev[p], &cur[c]);
+                    if (best_cost < 0 || total < best_cost) {
+                        best_cost = total;
+                        best = p;
+                    }
+                }
+            }
+            cost[e * MAX_CANDIDATES + c] = best_cost + placement(&cur[c], centre);
+            back[e * MAX_CANDIDATES + c] = best;
+        }
+    }
+
+    // Backtrack from the cheapest final candidate
+    int c = 0;
+    int *last_cost = &cost[(num_events - 1) * MAX_CANDIDATES];
+    for (int i = 1; i < num_cands[num_events - 1]; i++) {
+        if (last_cost[i] < last_cost[c]) c = i;
+    }
+    for (int e = num_events - 1; e >= 0; e--) {
+        events[e].voicing = cands[e * MAX_CANDIDATES + c];
+        c = back[e * MAX_CANDIDATES + c];
+    }
+
+    freebytes(cands, num_events * MAX_CANDIDATES * sizeof(t_voicing));
+    freebytes(num_cands, num_events * sizeof(int));
+    freebytes(cost, num_events * MAX_CANDIDATES * sizeof(int));
+    freebytes(back, num_events * MAX_CANDIDATES);
+}
@@ -0,0 +1,364 @@
+#include "m_pd.h"
+#include "pd_stub.h"
+#include "p_sheetmidi_types.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+// Stress test: many [p_sheetmidi] objects side by side on the headless Pd stub,
+// e.g. one per voice of a large patch. Loads charts, ticks and queries them at
+// performance rates, then reports memory, load time and tick cost. Fails (exit 1)
+// when an object goes over its footprint budget, leaks, or behaves differently
+// from the same object running alone.
+//
+//   make stress                 1000 objects
+//   make stress STRESS_ARGS=n   n objects
+
+#define DEFAULT_INSTANCES 1000
+#define RELOADS 10                 // Loads of the same chart per object
+#define TICK_ROUNDS 256            // Ticks per object
+#define TICK_MS 500                // Tick interval, quarter notes at 120 bpm
+#define LEARN_INSTANCES 4          // Objects that fill their learn corpus
+
+// Bytes per object as reported by [memory(, with one of the charts below loaded
+// (up to 24 written bars) and no learn corpus
+#define FOOTPRINT_BUDGET 8192
+
+// Bytes per object with a full learn corpus (MARKOV_MAX_CORPUS chords) and its tables
+#define LEARN_FOOTPRINT_BUDGET 131072
+
+// Charts with repeats, endings and jumps, loaded by the objects in turn
+static const char *charts[] = {
+    "|: Cmaj7 | Am7 |1. Dm7 | G7 :|2. Dm7 G7 | C To Coda | Fm7 | Bb7 D.C. al Coda | Coda Dm7 G7 | C6",
+    "Ebmaj7 Eb7 Ab6 . | Ebmaj7 Eb7 Ab6 . | Bbm7 Eb13 | Bbm7 E9#11 Eb9 A7b5 | Abmaj7 | Db9#11 | Gm7 C7b9 | Fm11 Bb7 | Eb13 Ab9 | Eb13 | Ab11",
+    "Fmaj7 | Em7b5 A7alt | Dm7 G7 | Cm7 F7 | Bbmaj7 | Bbm7 Eb7 | Am7 D7 | Gm7 C7 | "
+    "Fmaj7 | Em7b5 A7alt | Dm7 G7 | Cm7 F7 | Bbmaj7 | Bbm7 Eb7 | Gm7 C7 | Fmaj7",
+    "Segno Dm7 | G7 | Cmaj7 | >A7 | 3/4 Dm7 | G7 | 4/4 Em7 A7 | Dm7 G7 D.S. al Fine | Cmaj7 Fine",
+    "|: Am7 | D7 | Gmaj7 | Cmaj7 | F#m7b5 | B7alt |1. Em6 | Em6 :|2. Em6 | Em6 | "
+    "|: F#m7b5 | B7 | Em6 | Em6 | Am7 | D7 | Gmaj7 | Gmaj7 :| Bb7 | A7 | Dm7 G7 | C6",
+};
+#define NUM_CHARTS (int)(sizeof(charts) / sizeof(charts[0]))
+
+// Chords for the charts that fill the learn corpus
+static const char *learn_chords[] = {
+    "Cmaj7", "Dm7", "Em7", "Fmaj7", "G7", "Am7", "Bm7b5", "A7", "D7", "E7alt",
+    "Bb7", "Ebmaj7", "Abmaj7", "Db7", "F#m7b5", "B7", "Gm7", "C7", "Fm6", "Cm9",
+};
+#define NUM_LEARN_CHORDS (int)(sizeof(learn_chords) / sizeof(learn_chords[0]))
+
+void p_sheetmidi_setup(void);
+void *p_sheetmidi_new(t_symbol *s, int argc, t_atom *argv);
+
+typedef struct _instance {
+    t_p_sheetmidi *x;
+    unsigned int digest;       // Hash of everything sent through the outlets
+    long messages;
+    int memory[3];             // Last [memory( reply: total, chart, generator
+    int position[3];           // Last position from the beat outlet: beat, bar, beat in bar
+} t_instance;
+
+static t_instance *instances;
+static int num_instances;
+
+// Open addressing from object pointers to instances, for the outlet hook
+static t_instance **lookup;
+static int lookup_size;
+
+static int failures;
+
+// ---------------------------------------------------------------------------
+// Helpers
+
+static double now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static unsigned int hash_pointer(const void *p) {
+    unsigned long v = (unsigned long)p;
+    v ^= v >> 17;
+    v *= 0x9E3779B1u;
+    return (unsigned int)(v ^ (v >> 15));
+}
+
+static void register_instance(t_instance *inst) {
+    unsigned int i = hash_pointer(inst->x) & (lookup_size - 1);
+    while (lookup[i] && lookup[i]->x != inst->x) i = (i + 1) & (lookup_size - 1);
+    lookup[i] = inst;
+}
+
+static t_instance *find_instance(const t_object *owner) {
+    unsigned int i = hash_pointer(owner) & (lookup_size - 1);
+    while (lookup[i]) {
+        if ((t_object *)lookup[i]->x == owner) return lookup[i];
+        i = (i + 1) & (lookup_size - 1);
+    }
+    return NULL;
+}
+
+static unsigned int fnv(unsigned int hash, const void *data, size_t size) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < size; i++) hash = (hash ^ p[i]) * 16777619u;
+    return hash;
+}
+
+static void outlet_hook(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv) {
+    t_instance *inst = find_instance(owner);
+    if (!inst) return;
+    unsigned int h = fnv(inst->digest, &outlet, sizeof(outlet));
+    h = fnv(h, s->s_name, strlen(s->s_name));
+    for (int i = 0; i < argc; i++) {
+        if (argv[i].a_type == A_FLOAT) {
+            h = fnv(h, &argv[i].a_w.w_float, sizeof(t_float));
+        } else if (argv[i].a_type == A_SYMBOL) {
+            h = fnv(h, argv[i].a_w.w_symbol->s_name, strlen(argv[i].a_w.w_symbol->s_name));
+        }
+    }
+    inst->digest = h;
+    inst->messages++;
+
+    if (s == gensym("memory") && argc == 3) {
+        for (int i = 0; i < 3; i++) inst->memory[i] = (int)atom_getfloat(&argv[i]);
+    }
+    if (outlet == 2 && argc >= 3) {
+        for (int i = 0; i < 3; i++) inst->position[i] = (int)atom_getfloat(&argv[i]);
+    }
+}
+
+// Send a message like Pd would parse it: numbers become floats, a leading
+// number makes it a list
+static void send(t_instance *inst, int inlet, const char *msg) {
+    static t_atom atoms[1024];
+    char buf[4096];
+    int n = 0;
+    snprintf(buf, sizeof(buf), "%s", msg);
+    for (char *tok = strtok(buf, " "); tok && n < 1024; tok = strtok(NULL, " ")) {
+        char *end;
+        double f = strtod(tok, &end);
+        if (*end == 0 && end != tok) {
+            SETFLOAT(&atoms[n], f);
+        } else {
+            SETSYMBOL(&atoms[n], gensym(tok));
+        }
+        n++;
+    }
+    if (n == 0) return;
+    if (atoms[0].a_type == A_FLOAT) {
+        stub_send(&inst->x->x_obj, inlet, &s_list, n, atoms);
+    } else {
+        stub_send(&inst->x->x_obj, inlet, atoms[0].a_w.w_symbol, n - 1, atoms + 1);
+    }
+}
+
+static void check(int ok, const char *fmt, ...) {
+    if (ok) return;
+    failures++;
+    va_list ap;
+    va_start(ap, fmt);
+    printf("FAIL: ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+}
+
+// ---------------------------------------------------------------------------
+// The session every object runs, the same whether alone or among the others
+
+static void new_instance(t_instance *inst) {
+    memset(inst, 0, sizeof(*inst));
+    inst->digest = 2166136261u;
+    inst->x = (t_p_sheetmidi *)p_sheetmidi_new(gensym("p_sheetmidi"), 0, NULL);
+    register_instance(inst);
+}
+
+static void free_instance(t_instance *inst) {
+    unsigned int i = hash_pointer(inst->x) & (lookup_size - 1);
+    while (lookup[i] != inst) i = (i + 1) & (lookup_size - 1);
+    lookup[i] = NULL;
+    // Reinsert the rest of the cluster
+    for (i = (i + 1) & (lookup_size - 1); lookup[i]; i = (i + 1) & (lookup_size - 1)) {
+        t_instance *moved = lookup[i];
+        lookup[i] = NULL;
+        register_instance(moved);
+    }
+    pd_free(&inst->x->x_obj.te_g.g_pd);
+    inst->x = NULL;
+}
+
+// Loads the chart of object i RELOADS times, returns the mean time of a load in us
+static double load_instance(t_instance *inst, int i) {
+    char msg[64];
+    snprintf(msg, sizeof(msg), "transpose %d", i % 12 - 5);
+    send(inst, 0, msg);
+    if (i % 10 == 0) send(inst, 0, "arp up");
+    if (i % 7 == 0) send(inst, 0, "groove swing 60");
+
+    double t0 = now_us();
+    send(inst, 1, charts[i % NUM_CHARTS]);
+    double elapsed = now_us() - t0;
+    send(inst, 0, "memory");
+    int loaded = inst->memory[0];
+
+    t0 = now_us();
+    for (int r = 1; r < RELOADS; r++) send(inst, 1, charts[i % NUM_CHARTS]);
+    elapsed += now_us() - t0;
+    send(inst, 0, "memory");
+    check(inst->memory[0] == loaded, "object %d grew from %d to %d bytes over reloads",
+          i, loaded, inst->memory[0]);
+
+    snprintf(msg, sizeof(msg), "beat %d", i % 16);
+    send(inst, 1, msg);
+    return elapsed / RELOADS;
+}
+
+// One tick with the queries a voice makes on it, and now and then a jump to a cue
+static void tick_instance(t_instance *inst, int round) {
+    send(inst, 0, "tick");
+    send(inst, 0, "root");
+    send(inst, 0, "third");
+    send(inst, 0, "fifth");
+    if (round % 4 == 0) {
+        send(inst, 0, round % 8 ? "next 2" : "next");
+        send(inst, 0, "remaining");
+        send(inst, 0, "function");
+        send(inst, 0, "key");
+    }
+    if (round % 64 == 63) {
+        send(inst, 0, "bar 3 2");
+        check(inst->position[1] == 3 && inst->position[2] == 2,
+              "object at bar %d beat %d after 'bar 3 2'", inst->position[1], inst->position[2]);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+    num_instances = argc > 1 ? atoi(argv[1]) : DEFAULT_INSTANCES;
+    if (num_instances < 1) num_instances = 1;
+
+    lookup_size = 64;
+    while (lookup_size < 2 * (num_instances + LEARN_INSTANCES)) lookup_size *= 2;
+    lookup = (t_instance **)calloc(lookup_size, sizeof(t_instance *));
+    instances = (t_instance *)calloc(num_instances, sizeof(t_instance));
+    stub_outlet_hook = outlet_hook;
+
+    p_sheetmidi_setup();
+    printf("sizeof t_p_sheetmidi %zu, t_chord_event %zu, t_bar %zu, t_form_segment %zu\n",
+           sizeof(t_p_sheetmidi), sizeof(t_chord_event), sizeof(t_bar), sizeof(t_form_segment));
+
+    // Create and load
+    long base = stub_bytes;
+    double load_total = 0;
+    for (int i = 0; i < num_instances; i++) new_instance(&instances[i]);
+    for (int i = 0; i < num_instances; i++) load_total += load_instance(&instances[i], i);
+
+    long sum = 0;
+    int largest = 0, smallest = 1 << 30;
+    for (int i = 0; i < num_instances; i++) {
+        int total = instances[i].memory[0];
+        sum += total;
+        if (total > largest) largest = total;
+        if (total < smallest) smallest = total;
+        check(total <= FOOTPRINT_BUDGET, "object %d holds %d bytes, budget %d",
+              i, total, FOOTPRINT_BUDGET);
+    }
+    check(sum == stub_bytes - base, "%d objects report %ld bytes, %ld allocated",
+          num_instances, sum, stub_bytes - base);
+    printf("%d objects: %ld bytes, %ld per object (%d to %d, budget %d)\n",
+           num_instances, sum, sum / num_instances, smallest, largest, FOOTPRINT_BUDGET);
+    printf("load: %.1f us per chart\n", load_total / num_instances);
+
+    // Tick all objects in turn, like one metro driving every voice
+    double tick_total = 0, clock_total = 0;
+    for (int round = 0; round < TICK_ROUNDS; round++) {
+        double t0 = now_us();
+        for (int i = 0; i < num_instances; i++) tick_instance(&instances[i], round);
+        double t1 = now_us();
+        stub_advance(TICK_MS);
+        tick_total += t1 - t0;
+        clock_total += now_us() - t1;
+    }
+    double per_round = (tick_total + clock_total) / TICK_ROUNDS;
+    printf("tick: %.3f us per object and tick with queries, %.1f us per round of %d objects "
+           "(%.2f%% of the %d ms tick interval, arp clocks included)\n",
+           tick_total / ((double)TICK_ROUNDS * num_instances), per_round, num_instances,
+           per_round / (TICK_MS * 10.0), TICK_MS);
+
+    // Fill the learn corpus of a few objects with distinct charts
+    t_instance learners[LEARN_INSTANCES];
+    double learn_time = 0;
+    for (int l = 0; l < LEARN_INSTANCES; l++) {
+        t_instance *inst = &learners[l];
+        new_instance(inst);
+        unsigned int seed = 12345 + l;
+        int loads = 0;
+        while (inst->x->markov.corpus_size + 64 <= MARKOV_MAX_CORPUS) {
+            char chart[2048];
+            int len = 0;
+            for (int bar = 0; bar < 32; bar++) {
+                seed = seed * 1103515245u + 12345u;
+                const char *a = learn_chords[(seed >> 16) % NUM_LEARN_CHORDS];
+                seed = seed * 1103515245u + 12345u;
+                const char *b = learn_chords[(seed >> 16) % NUM_LEARN_CHORDS];
+                len += snprintf(chart + len, sizeof(chart) - len, "%s%s %s", bar ? " | " : "", a, b);
+            }
+            send(inst, 1, chart);
+            loads++;
+        }
+        double t0 = now_us();
+        send(inst, 0, "learn");
+        learn_time += now_us() - t0;
+        send(inst, 0, "generate 32 7");
+        send(inst, 0, "memory");
+        check(inst->memory[0] <= LEARN_FOOTPRINT_BUDGET, "learning object %d holds %d bytes, budget %d",
+              l, inst->memory[0], LEARN_FOOTPRINT_BUDGET);
+        if (l == 0) {
+            printf("learn: %d chords from %d charts, %d bytes (generator %d, budget %d), %.0f us\n",
+                   inst->x->markov.corpus_size, loads, inst->memory[0], inst->memory[2],
+                   LEARN_FOOTPRINT_BUDGET, learn_time);
+        }
+        send(inst, 0, "learn clear");
+        send(inst, 0, "memory");
+        check(inst->memory[2] == 0, "learning object %d keeps %d bytes after clear",
+              l, inst->memory[2]);
+    }
+
+    // Everything allocated must be returned
+    for (int l = 0; l < LEARN_INSTANCES; l++) free_instance(&learners[l]);
+    for (int i = 0; i < num_instances; i++) free_instance(&instances[i]);
+    check(stub_bytes == base, "%d objects leak %ld bytes", num_instances, stub_bytes - base);
+
+    // Isolation: each object alone must produce the same output as among the others
+    int differing = 0;
+    for (int i = 0; i < num_instances; i++) {
+        t_instance alone;
+        new_instance(&alone);
+        load_instance(&alone, i);
+        for (int round = 0; round < TICK_ROUNDS; round++) {
+            tick_instance(&alone, round);
+            stub_advance(TICK_MS);
+        }
+        if (alone.digest != instances[i].digest || alone.messages != instances[i].messages) {
+            if (differing++ < 5) {
+                check(0, "object %d differs when run alone (%ld messages, %ld among the others)",
+                      i, alone.messages, instances[i].messages);
+            }
+        }
+        free_instance(&alone);
+    }
+    if (differing > 5) {
+        check(0, "%d more objects differ when run alone", differing - 5);
+    }
+    printf("isolation: %d of %d objects identical when run alone\n",
+           num_instances - differing, num_instances);
+
+    if (failures) {
+        printf("stress: %d failures\n", failures);
+        return 1;
+    }
+    printf("stress: ok\n");
+    return 0;
+}
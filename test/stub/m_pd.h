@@ -0,0 +1,132 @@
+#ifndef M_PD_H
+#define M_PD_H
+
+// Headless stand-in for Pure Data's m_pd.h, just the part of the API the external
+// uses. Types and signatures follow Pd (0.51+) so the sources build unchanged.
+// Implemented in m_pd_stub.c, test controls are in pd_stub.h.
+
+#include <stddef.h>
+
+#define EXTERN extern
+#define MAXPDSTRING 1000
+
+typedef float t_float;
+typedef float t_floatarg;
+typedef float t_sample;
+
+typedef struct _symbol {
+    const char *s_name;
+    struct _class **s_thing;
+    struct _symbol *s_next;
+} t_symbol;
+
+typedef enum {
+    A_NULL, A_FLOAT, A_SYMBOL, A_POINTER, A_SEMI, A_COMMA,
+    A_DEFFLOAT, A_DEFSYM, A_DOLLAR, A_DOLLSYM, A_GIMME, A_CANT
+} t_atomtype;
+
+typedef union word {
+    t_float w_float;
+    t_symbol *w_symbol;
+    int w_index;
+} t_word;
+
+typedef struct _atom {
+    t_atomtype a_type;
+    union word a_w;
+} t_atom;
+
+typedef struct _class t_class;
+typedef t_class *t_pd;
+typedef struct _outlet t_outlet;
+typedef struct _inlet t_inlet;
+typedef struct _clock t_clock;
+typedef struct _binbuf t_binbuf;
+typedef struct _glist t_glist;
+typedef struct _glist t_canvas;
+typedef struct _garray t_garray;
+
+typedef struct _gobj {
+    t_pd g_pd;
+    struct _gobj *g_next;
+} t_gobj;
+
+typedef struct _text {
+    t_gobj te_g;
+    t_binbuf *te_binbuf;
+    t_outlet *te_outlet;
+    t_inlet *te_inlet;
+    short te_xpix;
+    short te_ypix;
+    short te_width;
+    unsigned int te_type:2;
+} t_text;
+
+typedef struct _text t_object;
+
+typedef void (*t_method)(void);
+typedef void *(*t_newmethod)(void);
+
+#define CLASS_DEFAULT 0
+#define CLASS_PD 1
+
+extern t_symbol s_float, s_list, s_symbol, s_bang, s_anything, s_;
+extern t_class *garray_class;
+
+// Symbols and atoms
+t_symbol *gensym(const char *s);
+t_float atom_getfloat(const t_atom *a);
+t_symbol *atom_getsymbol(const t_atom *a);
+t_float atom_getfloatarg(int which, int argc, const t_atom *argv);
+t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv);
+#define SETFLOAT(atom, f) ((atom)->a_type = A_FLOAT, (atom)->a_w.w_float = (f))
+#define SETSYMBOL(atom, s) ((atom)->a_type = A_SYMBOL, (atom)->a_w.w_symbol = (s))
+
+// Memory
+void *getbytes(size_t nbytes);
+void *resizebytes(void *old, size_t oldsize, size_t newsize);
+void freebytes(void *x, size_t nbytes);
+
+// Console
+void post(const char *fmt, ...);
+void pd_error(const void *object, const char *fmt, ...);
+
+// Classes and objects
+t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod,
+                   size_t size, int flags, t_atomtype arg1, ...);
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...);
+void class_addbang(t_class *c, t_method fn);
+void class_addanything(t_class *c, t_method fn);
+#define class_addbang(x, y) class_addbang((x), (t_method)(y))
+#define class_addanything(x, y) class_addanything((x), (t_method)(y))
+t_pd *pd_new(t_class *cls);
+void pd_free(t_pd *x);
+void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv);
+t_pd *pd_findbyclass(t_symbol *s, const t_class *c);
+
+// Inlets and outlets
+t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2);
+t_outlet *outlet_new(t_object *owner, t_symbol *s);
+void outlet_float(t_outlet *x, t_float f);
+void outlet_symbol(t_outlet *x, t_symbol *s);
+void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv);
+
+// Scheduler
+t_clock *clock_new(void *owner, t_method fn);
+void clock_free(t_clock *x);
+void clock_delay(t_clock *x, double delaytime);
+void clock_unset(t_clock *x);
+double clock_getlogicaltime(void);
+double clock_gettimesince(double prevsystime);
+
+// Canvases, files and arrays
+t_canvas *canvas_getcurrent(void);
+int canvas_open(const t_canvas *x, const char *name, const char *ext,
+                char *dirresult, char **nameresult, unsigned int size, int bin);
+int sys_close(int fd);
+int garray_getfloatwords(t_garray *x, int *size, t_word **vec);
+void garray_resize_long(t_garray *x, long n);
+void garray_redraw(t_garray *x);
+
+#endif // M_PD_H
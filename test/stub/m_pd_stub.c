@@ -0,0 +1,417 @@
+#include "m_pd.h"
+#include "pd_stub.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Headless implementation of the Pd API in m_pd.h: symbols, classes with message
+// dispatch, inlets and outlets, a logical clock and counted allocations
+
+t_symbol s_float = {"float", 0, 0};
+t_symbol s_list = {"list", 0, 0};
+t_symbol s_symbol = {"symbol", 0, 0};
+t_symbol s_bang = {"bang", 0, 0};
+t_symbol s_anything = {"anything", 0, 0};
+t_symbol s_ = {"", 0, 0};
+t_class *garray_class = NULL;
+
+long stub_bytes = 0;
+int stub_verbose = 0;
+t_stub_outlet_hook stub_outlet_hook = NULL;
+
+// ---------------------------------------------------------------------------
+// Symbols
+
+#define SYMBOL_BUCKETS 4096
+
+static t_symbol *symbol_buckets[SYMBOL_BUCKETS];
+
+t_symbol *gensym(const char *s) {
+    unsigned int hash = 2166136261u;
+    for (const char *p = s; *p; p++) hash = (hash ^ (unsigned char)*p) * 16777619u;
+    t_symbol **bucket = &symbol_buckets[hash % SYMBOL_BUCKETS];
+    for (t_symbol *sym = *bucket; sym; sym = sym->s_next) {
+        if (strcmp(sym->s_name, s) == 0) return sym;
+    }
+    t_symbol *sym = (t_symbol *)calloc(1, sizeof(t_symbol));
+    char *name = (char *)malloc(strlen(s) + 1);
+    strcpy(name, s);
+    sym->s_name = name;
+    sym->s_next = *bucket;
+    *bucket = sym;
+    return sym;
+}
+
+t_float atom_getfloat(const t_atom *a) {
+    return a->a_type == A_FLOAT ? a->a_w.w_float : 0;
+}
+
+t_symbol *atom_getsymbol(const t_atom *a) {
+    return a->a_type == A_SYMBOL ? a->a_w.w_symbol : &s_;
+}
+
+t_float atom_getfloatarg(int which, int argc, const t_atom *argv) {
+    return which >= 0 && which < argc ? atom_getfloat(&argv[which]) : 0;
+}
+
+t_symbol *atom_getsymbolarg(int which, int argc, const t_atom *argv) {
+    return which >= 0 && which < argc ? atom_getsymbol(&argv[which]) : &s_;
+}
+
+// ---------------------------------------------------------------------------
+// Memory, every byte the external allocates is counted in stub_bytes
+
+void *getbytes(size_t nbytes) {
+    void *p = calloc(1, nbytes ? nbytes : 1);
+    if (p) stub_bytes += nbytes;
+    return p;
+}
+
+void *resizebytes(void *old, size_t oldsize, size_t newsize) {
+    void *p = realloc(old, newsize ? newsize : 1);
+    if (!p) return NULL;
+    if (newsize > oldsize) memset((char *)p + oldsize, 0, newsize - oldsize);
+    stub_bytes += (long)newsize - (long)oldsize;
+    return p;
+}
+
+void freebytes(void *x, size_t nbytes) {
+    stub_bytes -= nbytes;
+    free(x);
+}
+
+// ---------------------------------------------------------------------------
+// Console
+
+void post(const char *fmt, ...) {
+    if (!stub_verbose) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+}
+
+void pd_error(const void *object, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "error: ");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fprintf(stderr, "\n");
+}
+
+// ---------------------------------------------------------------------------
+// Classes and message dispatch
+
+#define MAX_METHODS 64
+#define MAX_ARGS 4
+
+typedef struct _stub_method {
+    t_symbol *sel;
+    t_method fn;
+    t_atomtype args[MAX_ARGS];  // A_FLOAT or A_DEFFLOAT each, or a single A_GIMME
+    int num_args;
+} t_stub_method;
+
+struct _class {
+    t_symbol *name;
+    size_t size;
+    t_method freemethod;
+    t_method bang;
+    t_method anything;
+    t_stub_method methods[MAX_METHODS];
+    int num_methods;
+};
+
+typedef void (*t_plain_method)(void *x);
+typedef void (*t_float1_method)(void *x, t_floatarg a);
+typedef void (*t_float2_method)(void *x, t_floatarg a, t_floatarg b);
+typedef void (*t_float3_method)(void *x, t_floatarg a, t_floatarg b, t_floatarg c);
+typedef void (*t_float4_method)(void *x, t_floatarg a, t_floatarg b, t_floatarg c, t_floatarg d);
+typedef void (*t_gimme_method)(void *x, t_symbol *s, int argc, t_atom *argv);
+
+t_class *class_new(t_symbol *name, t_newmethod newmethod, t_method freemethod,
+                   size_t size, int flags, t_atomtype arg1, ...) {
+    t_class *c = (t_class *)calloc(1, sizeof(t_class));
+    c->name = name;
+    c->size = size;
+    c->freemethod = freemethod;
+    return c;
+}
+
+void class_addmethod(t_class *c, t_method fn, t_symbol *sel, t_atomtype arg1, ...) {
+    if (c->num_methods >= MAX_METHODS) {
+        pd_error(NULL, "%s: too many methods", c->name->s_name);
+        return;
+    }
+    t_stub_method *m = &c->methods[c->num_methods];
+    m->sel = sel;
+    m->fn = fn;
+    m->num_args = 0;
+
+    va_list ap;
+    va_start(ap, arg1);
+    for (t_atomtype arg = arg1; arg != A_NULL; arg = (t_atomtype)va_arg(ap, int)) {
+        if (m->num_args >= MAX_ARGS ||
+            (arg != A_FLOAT && arg != A_DEFFLOAT && (arg != A_GIMME || m->num_args > 0))) {
+            pd_error(NULL, "%s: unsupported arguments for '%s'", c->name->s_name, sel->s_name);
+            va_end(ap);
+            return;
+        }
+        m->args[m->num_args++] = arg;
+    }
+    va_end(ap);
+    c->num_methods++;
+}
+
+#undef class_addbang
+#undef class_addanything
+
+void class_addbang(t_class *c, t_method fn) {
+    c->bang = fn;
+}
+
+void class_addanything(t_class *c, t_method fn) {
+    c->anything = fn;
+}
+
+t_pd *pd_new(t_class *cls) {
+    t_pd *x = (t_pd *)getbytes(cls->size);
+    if (x) *x = cls;
+    return x;
+}
+
+struct _inlet {
+    t_pd *dest;
+    t_inlet *next;
+};
+
+struct _outlet {
+    t_object *owner;
+    int index;
+    t_outlet *next;
+};
+
+void pd_free(t_pd *x) {
+    t_class *c = *x;
+    if (c->freemethod) ((t_plain_method)c->freemethod)(x);
+    if (c->size >= sizeof(t_object)) {
+        t_object *ob = (t_object *)x;
+        while (ob->te_inlet) {
+            t_inlet *next = ob->te_inlet->next;
+            free(ob->te_inlet);
+            ob->te_inlet = next;
+        }
+        while (ob->te_outlet) {
+            t_outlet *next = ob->te_outlet->next;
+            free(ob->te_outlet);
+            ob->te_outlet = next;
+        }
+    }
+    freebytes(x, c->size);
+}
+
+void pd_typedmess(t_pd *x, t_symbol *s, int argc, t_atom *argv) {
+    t_class *c = *x;
+    if (s == &s_bang && argc == 0 && c->bang) {
+        ((t_plain_method)c->bang)(x);
+        return;
+    }
+    for (int i = 0; i < c->num_methods; i++) {
+        t_stub_method *m = &c->methods[i];
+        if (m->sel != s) continue;
+        if (m->num_args == 1 && m->args[0] == A_GIMME) {
+            ((t_gimme_method)m->fn)(x, s, argc, argv);
+            return;
+        }
+        // Every declared float, missing ones are 0 like Pd's A_DEFFLOAT
+        t_floatarg f[MAX_ARGS];
+        for (int a = 0; a < m->num_args; a++) f[a] = atom_getfloatarg(a, argc, argv);
+        switch (m->num_args) {
+            case 0: ((t_plain_method)m->fn)(x); break;
+            case 1: ((t_float1_method)m->fn)(x, f[0]); break;
+            case 2: ((t_float2_method)m->fn)(x, f[0], f[1]); break;
+            case 3: ((t_float3_method)m->fn)(x, f[0], f[1], f[2]); break;
+            default: ((t_float4_method)m->fn)(x, f[0], f[1], f[2], f[3]); break;
+        }
+        return;
+    }
+    if (c->anything) {
+        ((t_gimme_method)c->anything)(x, s, argc, argv);
+        return;
+    }
+    pd_error(x, "%s: no method for '%s'", c->name->s_name, s->s_name);
+}
+
+t_pd *pd_findbyclass(t_symbol *s, const t_class *c) {
+    return NULL;  // No patch, so no named objects
+}
+
+void stub_send(t_object *x, int inlet, t_symbol *s, int argc, t_atom *argv) {
+    if (inlet == 0) {
+        pd_typedmess(&x->te_g.g_pd, s, argc, argv);
+        return;
+    }
+    t_inlet *in = x->te_inlet;
+    for (int i = 1; in && i < inlet; i++) in = in->next;
+    if (!in) {
+        pd_error(x, "no inlet %d", inlet);
+        return;
+    }
+    pd_typedmess(in->dest, s, argc, argv);
+}
+
+// ---------------------------------------------------------------------------
+// Inlets and outlets, outlets report to stub_outlet_hook
+
+t_inlet *inlet_new(t_object *owner, t_pd *dest, t_symbol *s1, t_symbol *s2) {
+    t_inlet *in = (t_inlet *)calloc(1, sizeof(t_inlet));
+    in->dest = dest;
+    t_inlet **last = &owner->te_inlet;
+    while (*last) last = &(*last)->next;
+    *last = in;
+    return in;
+}
+
+t_outlet *outlet_new(t_object *owner, t_symbol *s) {
+    t_outlet *out = (t_outlet *)calloc(1, sizeof(t_outlet));
+    out->owner = owner;
+    t_outlet **last = &owner->te_outlet;
+    while (*last) {
+        out->index++;
+        last = &(*last)->next;
+    }
+    *last = out;
+    return out;
+}
+
+void outlet_float(t_outlet *x, t_float f) {
+    t_atom a;
+    SETFLOAT(&a, f);
+    if (stub_outlet_hook) stub_outlet_hook(x->owner, x->index, &s_float, 1, &a);
+}
+
+void outlet_symbol(t_outlet *x, t_symbol *s) {
+    t_atom a;
+    SETSYMBOL(&a, s);
+    if (stub_outlet_hook) stub_outlet_hook(x->owner, x->index, &s_symbol, 1, &a);
+}
+
+void outlet_list(t_outlet *x, t_symbol *s, int argc, t_atom *argv) {
+    if (stub_outlet_hook) stub_outlet_hook(x->owner, x->index, &s_list, argc, argv);
+}
+
+void outlet_anything(t_outlet *x, t_symbol *s, int argc, t_atom *argv) {
+    if (stub_outlet_hook) stub_outlet_hook(x->owner, x->index, s, argc, argv);
+}
+
+// ---------------------------------------------------------------------------
+// Scheduler: logical time in ms, clocks run from stub_advance()
+
+struct _clock {
+    void *owner;
+    t_method fn;
+    double when;
+    int active;          // Index in active_clocks, -1 when unset
+};
+
+static double logical_time = 0;
+static t_clock **active_clocks = NULL;
+static int num_active = 0;
+static int active_capacity = 0;
+
+t_clock *clock_new(void *owner, t_method fn) {
+    t_clock *c = (t_clock *)calloc(1, sizeof(t_clock));
+    c->owner = owner;
+    c->fn = fn;
+    c->active = -1;
+    return c;
+}
+
+void clock_unset(t_clock *x) {
+    if (x->active < 0) return;
+    active_clocks[x->active] = active_clocks[--num_active];
+    active_clocks[x->active]->active = x->active;
+    x->active = -1;
+}
+
+void clock_free(t_clock *x) {
+    clock_unset(x);
+    free(x);
+}
+
+void clock_delay(t_clock *x, double delaytime) {
+    x->when = logical_time + (delaytime > 0 ? delaytime : 0);
+    if (x->active >= 0) return;
+    if (num_active == active_capacity) {
+        active_capacity = active_capacity ? active_capacity * 2 : 64;
+        active_clocks = (t_clock **)realloc(active_clocks, active_capacity * sizeof(t_clock *));
+    }
+    x->active = num_active;
+    active_clocks[num_active++] = x;
+}
+
+double clock_getlogicaltime(void) {
+    return logical_time;
+}
+
+double clock_gettimesince(double prevsystime) {
+    return logical_time - prevsystime;
+}
+
+void stub_advance(double ms) {
+    double target = logical_time + ms;
+    for (;;) {
+        t_clock *next = NULL;
+        for (int i = 0; i < num_active; i++) {
+            if (active_clocks[i]->when <= target && (!next || active_clocks[i]->when < next->when)) {
+                next = active_clocks[i];
+            }
+        }
+        if (!next) break;
+        if (next->when > logical_time) logical_time = next->when;
+        clock_unset(next);
+        ((t_plain_method)next->fn)(next->owner);
+    }
+    logical_time = target;
+}
+
+// ---------------------------------------------------------------------------
+// Canvases, files and arrays
+
+t_canvas *canvas_getcurrent(void) {
+    return NULL;
+}
+
+// Files are looked up relative to the working directory
+int canvas_open(const t_canvas *x, const char *name, const char *ext,
+                char *dirresult, char **nameresult, unsigned int size, int bin) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return -1;
+    const char *slash = strrchr(name, '/');
+    if (slash) {
+        snprintf(dirresult, size, "%.*s", (int)(slash - name), name);
+    } else {
+        snprintf(dirresult, size, ".");
+    }
+    *nameresult = (char *)(slash ? slash + 1 : name);
+    return fd;
+}
+
+int sys_close(int fd) {
+    return close(fd);
+}
+
+int garray_getfloatwords(t_garray *x, int *size, t_word **vec) {
+    return 0;
+}
+
+void garray_resize_long(t_garray *x, long n) {
+}
+
+void garray_redraw(t_garray *x) {
+}
@@ -0,0 +1,22 @@
+#ifndef PD_STUB_H
+#define PD_STUB_H
+
+#include "m_pd.h"
+
+// Test controls of the headless Pd stub
+
+// Called for every message leaving an outlet: the object, the outlet number
+// (counting from 0) and the message
+typedef void (*t_stub_outlet_hook)(t_object *owner, int outlet, t_symbol *s, int argc, t_atom *argv);
+
+extern long stub_bytes;          // Bytes currently allocated through getbytes/resizebytes
+extern int stub_verbose;         // Print post() messages
+extern t_stub_outlet_hook stub_outlet_hook;
+
+// Send a message to an inlet of an object (0 = the object itself)
+void stub_send(t_object *x, int inlet, t_symbol *s, int argc, t_atom *argv);
+
+// Advance logical time, running the clocks that come due in order
+void stub_advance(double ms);
+
+#endif // PD_STUB_H